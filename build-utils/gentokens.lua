@@ -37,53 +37,90 @@ __attribute__((pure)) enum luapdf_token_t l_tokenize(const gchar *s);
 tokenize_c = [[
 /* This file is autogenerated by build-utils/gentokens.lua */
 
-#include <glib/ghash.h>
+#include <string.h>
 #include "common/tokenize.h"
 
-static GHashTable *tokens = NULL;
-
-typedef struct {
-    luapdf_token_t tok;
-    const gchar *name;
-} token_map_t;
-
-token_map_t tokens_table[] = {
-    %s
-    { 0, NULL },
-};
-
+/* A trie of nested switch statements over the characters of all tokens. Each
+ * lookup only touches the characters of the string until it is either
+ * unambiguous or unknown. */
 luapdf_token_t l_tokenize(const gchar *s)
 {
-    if (!tokens) {
-        tokens = g_hash_table_new(g_str_hash, g_str_equal);
-        for (token_map_t *t = tokens_table; t->name; t++)
-            g_hash_table_insert(tokens, (gpointer) t->name, (gpointer) t->tok);
-    }
-
-    return (luapdf_token_t) g_hash_table_lookup(tokens, s);
+%s
 }
 ]]
 
+-- Generate the switch statements of all tokens in `names` which share their
+-- first `depth` characters.
+function gen_trie(names, depth, indent)
+    local lines = {}
+    local pad = string.rep("    ", indent)
+
+    -- Only one candidate left, compare the remaining characters
+    if #names == 1 then
+        local name = names[1]
+        table.insert(lines, string.format('%sreturn strcmp(s + %d, "%s") ? L_TK_UNKNOWN : %s;',
+            pad, depth, string.sub(name, depth + 1), tokens[name]))
+        return lines
+    end
+
+    -- Group candidates by their next character
+    local groups, chars, terminal = {}, {}, nil
+    for _, name in ipairs(names) do
+        if #name == depth then
+            terminal = name
+        else
+            local c = string.sub(name, depth + 1, depth + 1)
+            if not groups[c] then
+                groups[c] = {}
+                table.insert(chars, c)
+            end
+            table.insert(groups[c], name)
+        end
+    end
+    table.sort(chars)
+
+    table.insert(lines, string.format("%sswitch (s[%d]) {", pad, depth))
+    if terminal then
+        table.insert(lines, pad .. "  case '\\0':")
+        table.insert(lines, string.format("%s    return %s;", pad, tokens[terminal]))
+    end
+    for _, c in ipairs(chars) do
+        table.insert(lines, string.format("%s  case '%s':", pad, c))
+        for _, line in ipairs(gen_trie(groups[c], depth + 1, indent + 1)) do
+            table.insert(lines, line)
+        end
+    end
+    table.insert(lines, pad .. "  default:")
+    table.insert(lines, pad .. "    return L_TK_UNKNOWN;")
+    table.insert(lines, pad .. "}")
+    return lines
+end
+
 if #arg ~= 2 then
     error("invalid args, usage: gentokens.lua [token list] [out.c/out.h]")
 end
 
 -- Load list of tokens
 tokens = {}
+names = {}
 for token in io.lines(arg[1]) do
     if #token > 0 then
         if not string.match(token, "^[%w_]+$") then
             error(string.format("invalid token: %q", token))
         end
-        tokens["L_TK_" .. string.upper(token)] = token
+        if not tokens[token] then
+            tokens[token] = "L_TK_" .. string.upper(token)
+            table.insert(names, token)
+        end
     end
 end
+table.sort(names)
 
 if string.match(arg[2], "%.h$") then
     -- Gen list of tokens
     enums = {}
-    for k, _ in pairs(tokens) do
-        table.insert(enums, string.format("%s,", k))
+    for _, name in ipairs(names) do
+        table.insert(enums, string.format("%s,", tokens[name]))
     end
     table.sort(enums)
 
@@ -93,15 +130,12 @@ if string.match(arg[2], "%.h$") then
     fh:close()
 
 elseif string.match(arg[2], "%.c$") then
-    -- Gen table of { token, "literal" }
-    tok_table = {}
-    for k, v in pairs(tokens) do
-        table.insert(tok_table, string.format('{ %s, "%s" },', k, v))
-    end
+    -- Gen token lookup trie
+    trie = gen_trie(names, 0, 1)
 
     -- Write source file
     fh = io.open(arg[2], "w")
-    fh:write(string.format(tokenize_c, table.concat(tok_table, "\n    ")))
+    fh:write(string.format(tokenize_c, table.concat(trie, "\n")))
     fh:close()
 
 else
@@ -0,0 +1,136 @@
+/*
+ * build-utils/tokbench.c - l_tokenize microbenchmark
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Compares the generated l_tokenize trie against the GHashTable lookup it
+ * replaced. Run with `make bench`. */
+
+#include <glib.h>
+#include <glib/gprintf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/tokenize.h"
+
+#define ROUNDS 200000
+
+/* a few of the hottest property names plus some misses */
+static const gchar *extra[] = {
+    "x", "y", "width", "height", "scroll", "pages", "zoom", "xmax", "ymax",
+    "ypage_size", "add_signal", "emit_signal", "undefined", "pagesx",
+};
+
+/* sort enum names like gentokens.lua does */
+static gint
+enum_cmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar**) a, *(const gchar**) b);
+}
+
+static gint64
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((gint64) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+gint
+main(gint argc, gchar *argv[])
+{
+    GPtrArray *names = g_ptr_array_new();
+    GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *enums = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GPtrArray *sorted = g_ptr_array_new();
+    gchar *contents, **lines;
+    volatile guint sink = 0;
+    gint64 start, trie, hash;
+
+    if (argc != 2) {
+        g_fprintf(stderr, "usage: %s common/tokenize.list\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!g_file_get_contents(argv[1], &contents, NULL, NULL)) {
+        g_fprintf(stderr, "unable to read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    /* the enum values are the positions of the L_TK_* names in sorted
+     * order, counted from 1 (L_TK_UNKNOWN is 0) */
+    lines = g_strsplit(contents, "\n", -1);
+    for (gchar **l = lines; *l; l++) {
+        if (!**l || g_hash_table_lookup(table, *l))
+            continue;
+        gchar *upper = g_ascii_strup(*l, -1);
+        gchar *e = g_strconcat("L_TK_", upper, NULL);
+        g_free(upper);
+        g_hash_table_insert(enums, e, *l);
+        g_hash_table_insert(table, *l, GUINT_TO_POINTER(1));
+        g_ptr_array_add(sorted, e);
+        g_ptr_array_add(names, *l);
+    }
+    g_ptr_array_sort(sorted, enum_cmp);
+
+    /* build the hash table from the enum order, independent of l_tokenize */
+    for (guint i = 0; i < sorted->len; i++)
+        g_hash_table_insert(table, g_hash_table_lookup(enums, sorted->pdata[i]),
+                GUINT_TO_POINTER(i + 1));
+    for (guint i = 0; i < G_N_ELEMENTS(extra); i++)
+        g_ptr_array_add(names, (gpointer) extra[i]);
+
+    /* both implementations must agree, misses are L_TK_UNKNOWN in both */
+    for (guint i = 0; i < names->len; i++) {
+        const gchar *n = names->pdata[i];
+        if (GPOINTER_TO_UINT(g_hash_table_lookup(table, n)) != l_tokenize(n)) {
+            g_fprintf(stderr, "mismatch for token \"%s\"\n", n);
+            return EXIT_FAILURE;
+        }
+    }
+
+    start = now();
+    for (gint r = 0; r < ROUNDS; r++)
+        for (guint i = 0; i < names->len; i++)
+            sink += l_tokenize(names->pdata[i]);
+    trie = now() - start;
+
+    start = now();
+    for (gint r = 0; r < ROUNDS; r++)
+        for (guint i = 0; i < names->len; i++)
+            sink += GPOINTER_TO_UINT(g_hash_table_lookup(table,
+                        names->pdata[i]));
+    hash = now() - start;
+
+    gdouble lookups = (gdouble) ROUNDS * names->len;
+    g_printf("%u names, %d rounds\n", names->len, ROUNDS);
+    g_printf("trie:       %6.2f ns/lookup\n", trie / lookups);
+    g_printf("GHashTable: %6.2f ns/lookup\n", hash / lookups);
+    g_printf("speedup:    %6.2fx\n", (gdouble) hash / trie);
+
+    g_hash_table_destroy(table);
+    g_hash_table_destroy(enums);
+    g_ptr_array_free(sorted, TRUE);
+    g_ptr_array_free(names, TRUE);
+    g_strfreev(lines);
+    g_free(contents);
+    return EXIT_SUCCESS;
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -0,0 +1,368 @@
+/*
+ * clib/fs.c - asynchronous file I/O
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The functions of luapdf.fs queue a job and return at once. All jobs run on
+ * a single worker thread, so they complete in the order they were queued
+ * (an append followed by a read sees the appended data). The worker never
+ * touches the Lua state: the results are handed back to the main loop where
+ * the Lua callback is called with the result or nil and an error message.
+ * Queued jobs are finished before luapdf exits. */
+
+#include "clib/fs.h"
+#include "common/luaobject.h"
+#include "globalconf.h"
+#include "luah.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef enum {
+    FS_READ,
+    FS_WRITE,
+    FS_APPEND,
+    FS_STAT,
+    FS_LIST,
+} fs_op_t;
+
+typedef struct {
+    fs_op_t op;
+    gchar *path;
+    /* data to write or the contents read */
+    gchar *data;
+    gsize len;
+    /* the sorted entries of a directory */
+    gchar **names;
+    /* the result of a stat */
+    GStatBuf st;
+    /* error message or NULL on success */
+    gchar *error;
+    /* reference to the Lua callback or NULL */
+    gpointer cb;
+} fs_job_t;
+
+static GThreadPool *fs_pool;
+
+/* sort directory entries by name */
+static gint
+fs_name_cmp(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar**) a, *(const gchar**) b);
+}
+
+static gboolean
+fs_append(fs_job_t *job)
+{
+    FILE *f = g_fopen(job->path, "ab");
+    if (!f)
+        return FALSE;
+    gboolean ok = fwrite(job->data, 1, job->len, f) == job->len;
+    return (fclose(f) == 0) && ok;
+}
+
+static gboolean
+fs_list(fs_job_t *job, GError **e)
+{
+    GPtrArray *names = g_ptr_array_new();
+    const gchar *name;
+    GDir *dir;
+
+    if (!(dir = g_dir_open(job->path, 0, e))) {
+        g_ptr_array_free(names, TRUE);
+        return FALSE;
+    }
+    while ((name = g_dir_read_name(dir)))
+        g_ptr_array_add(names, g_strdup(name));
+    g_dir_close(dir);
+
+    g_ptr_array_sort(names, fs_name_cmp);
+    g_ptr_array_add(names, NULL);
+    job->names = (gchar**) g_ptr_array_free(names, FALSE);
+    return TRUE;
+}
+
+static void
+fs_job_free(fs_job_t *job)
+{
+    g_free(job->path);
+    g_free(job->data);
+    g_strfreev(job->names);
+    g_free(job->error);
+    g_slice_free(fs_job_t, job);
+}
+
+/* Calls the Lua callback of a finished job on the main loop */
+static gboolean
+fs_done_cb(gpointer data)
+{
+    fs_job_t *job = data;
+    lua_State *L = globalconf.L;
+    gint nargs = 1;
+
+    if (!job->cb) {
+        if (job->error)
+            warn("luapdf.fs: %s", job->error);
+        fs_job_free(job);
+        return FALSE;
+    }
+
+    luaH_object_push(L, job->cb);
+    if (job->error) {
+        lua_pushnil(L);
+        lua_pushstring(L, job->error);
+        nargs = 2;
+    } else switch (job->op) {
+      case FS_READ:
+        lua_pushlstring(L, job->data, job->len);
+        break;
+
+      case FS_STAT:
+        lua_createtable(L, 0, 4);
+        lua_pushstring(L, S_ISDIR(job->st.st_mode) ? "directory"
+                : S_ISREG(job->st.st_mode) ? "file" : "other");
+        lua_setfield(L, -2, "type");
+        lua_pushnumber(L, job->st.st_size);
+        lua_setfield(L, -2, "size");
+        lua_pushnumber(L, job->st.st_mtime);
+        lua_setfield(L, -2, "mtime");
+        lua_pushinteger(L, job->st.st_mode & 07777);
+        lua_setfield(L, -2, "mode");
+        break;
+
+      case FS_LIST:
+        lua_createtable(L, g_strv_length(job->names), 0);
+        for (gint i = 0; job->names[i]; i++) {
+            lua_pushstring(L, job->names[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        break;
+
+      default:
+        lua_pushboolean(L, TRUE);
+        break;
+    }
+
+    if (lua_pcall(L, nargs, 0, 0)) {
+        warn("error in luapdf.fs callback: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    luaH_object_unref(L, job->cb);
+    fs_job_free(job);
+    return FALSE;
+}
+
+/* Runs a job on the worker thread */
+static void
+fs_worker(gpointer data, gpointer UNUSED(user_data))
+{
+    fs_job_t *job = data;
+    GError *e = NULL;
+    gboolean ok = FALSE;
+    errno = 0;
+
+    switch (job->op) {
+      case FS_READ:
+        ok = g_file_get_contents(job->path, &job->data, &job->len, &e);
+        break;
+      case FS_WRITE:
+        /* writes a temporary file and renames it over the old one */
+        ok = g_file_set_contents(job->path, job->data, job->len, &e);
+        break;
+      case FS_APPEND:
+        ok = fs_append(job);
+        break;
+      case FS_STAT:
+        ok = !g_stat(job->path, &job->st);
+        break;
+      case FS_LIST:
+        ok = fs_list(job, &e);
+        break;
+    }
+
+    if (e) {
+        job->error = g_strdup(e->message);
+        g_error_free(e);
+    } else if (!ok)
+        job->error = g_strdup_printf("%s: %s", job->path, g_strerror(errno));
+
+    g_idle_add(fs_done_cb, job);
+}
+
+/* finish all queued jobs before exiting */
+static void
+fs_flush(void)
+{
+    if (fs_pool)
+        g_thread_pool_free(fs_pool, FALSE, TRUE);
+    fs_pool = NULL;
+}
+
+/* Queues a job, the callback is at the given index of the Lua stack */
+static gint
+fs_queue(lua_State *L, fs_op_t op, gint cbidx, const gchar *data, gsize len)
+{
+    GError *e = NULL;
+    fs_job_t *job;
+
+    /* check the arguments before allocating anything */
+    const gchar *path = luaL_checkstring(L, 1);
+    gboolean has_cb = !lua_isnoneornil(L, cbidx);
+    if (has_cb)
+        luaH_checkfunction(L, cbidx);
+
+    job = g_slice_new0(fs_job_t);
+    job->op = op;
+    job->path = g_strdup(path);
+    if (data && len) {
+        /* g_memdup is deprecated and takes a guint length */
+        job->data = g_malloc(len);
+        memcpy(job->data, data, len);
+    }
+    job->len = len;
+    if (has_cb)
+        job->cb = luaH_object_ref(L, cbidx);
+
+    if (!fs_pool) {
+        fs_pool = g_thread_pool_new(fs_worker, NULL, 1, FALSE, &e);
+        if (!fs_pool) {
+            luaH_object_unref(L, job->cb);
+            fs_job_free(job);
+            lua_pushstring(L, e->message);
+            g_error_free(e);
+            return lua_error(L);
+        }
+        atexit(fs_flush);
+    }
+
+    g_thread_pool_push(fs_pool, job, NULL);
+    return 0;
+}
+
+/** Reads a whole file.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path The file to read.
+ * \lparam callback Called with the contents or nil and an error message.
+ */
+static gint
+luaH_fs_read_file(lua_State *L)
+{
+    return fs_queue(L, FS_READ, 2, NULL, 0);
+}
+
+/** Replaces the contents of a file. The data is written to a temporary file
+ * which is then renamed, so the file is never seen half written.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path The file to write.
+ * \lparam data The new contents.
+ * \lparam callback Optional, called with true or nil and an error message.
+ */
+static gint
+luaH_fs_write_file(lua_State *L)
+{
+    size_t len;
+    const gchar *data = luaL_checklstring(L, 2, &len);
+    return fs_queue(L, FS_WRITE, 3, data, len);
+}
+
+/** Appends data to a file, creating it if necessary.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path The file to append to.
+ * \lparam data The data to append.
+ * \lparam callback Optional, called with true or nil and an error message.
+ */
+static gint
+luaH_fs_append(lua_State *L)
+{
+    size_t len;
+    const gchar *data = luaL_checklstring(L, 2, &len);
+    return fs_queue(L, FS_APPEND, 3, data, len);
+}
+
+/** Gets the type, size, modification time and mode of a file.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path The file.
+ * \lparam callback Called with a table or nil and an error message.
+ */
+static gint
+luaH_fs_stat(lua_State *L)
+{
+    return fs_queue(L, FS_STAT, 2, NULL, 0);
+}
+
+/** Lists the entries of a directory.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path The directory.
+ * \lparam callback Called with the sorted array of entry names or nil and an
+ * error message.
+ */
+static gint
+luaH_fs_list_dir(lua_State *L)
+{
+    return fs_queue(L, FS_LIST, 2, NULL, 0);
+}
+
+void
+fs_lib_setup(lua_State *L)
+{
+    static const struct luaL_reg fs_lib[] =
+    {
+        { "read_file",  luaH_fs_read_file },
+        { "write_file", luaH_fs_write_file },
+        { "append",     luaH_fs_append },
+        { "stat",       luaH_fs_stat },
+        { "list_dir",   luaH_fs_list_dir },
+        { NULL,         NULL }
+    };
+
+    /* export as luapdf.fs, bypassing luapdf.__newindex */
+    lua_getglobal(L, "luapdf");
+    lua_pushliteral(L, "fs");
+    lua_newtable(L);
+    luaL_register(L, NULL, fs_lib);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -1,6 +1,5 @@
 /*
- * clib/unique.c - libunique bindings for writing single instance
- * applications
+ * clib/fs.h - asynchronous file I/O
  *
  * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
  *
@@ -19,16 +18,13 @@
  *
  */
 
-#if WITH_UNIQUE
-
-#ifndef LUAPDF_CLIB_UNIQUE_H
-#define LUAPDF_CLIB_UNIQUE_H
+#ifndef LUAPDF_CLIB_FS_H
+#define LUAPDF_CLIB_FS_H
 
 #include <lua.h>
 
-void unique_lib_setup(lua_State*);
+void fs_lib_setup(lua_State *);
 
-#endif /* #if LUAPDF_CLIB_UNIQUE_H */
-#endif /* #if WITH_UNIQUE */
+#endif
 
 // vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -0,0 +1,568 @@
+/*
+ * clib/ipc.c - local socket IPC
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* A luapdf instance listens on a Unix domain socket (see
+ * ipc_default_path()) so that other processes, like client/luapdfc.c, can
+ * talk to it without a session bus.
+ *
+ * The protocol is line based: every line a client sends is a request and is
+ * emitted as the "message" signal of the ipc lib. The first value returned by
+ * a handler is sent back as a single reply line. Backslashes and newlines in
+ * requests and replies are escaped as "\\" and "\n". Replies are queued and
+ * written as the client reads them, so a client can send any number of
+ * requests before it reads the first reply.
+ *
+ * Only processes of the same user may talk to each other: the socket lives in
+ * a directory only the user can access, a client checks the owner of the
+ * socket and both ends check the uid of their peer. */
+
+/* struct ucred */
+#define _GNU_SOURCE
+
+#include "clib/ipc.h"
+#include "common/luaobject.h"
+#include "globalconf.h"
+#include "luah.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* seconds to wait for a reply when acting as a client */
+#define IPC_TIMEOUT 5
+
+/* bytes of queued replies after which no more requests of a client are read
+ * until it reads the replies */
+#define IPC_MAX_PENDING (1024 * 1024)
+
+/* a connected client */
+typedef struct {
+    GIOChannel *channel;
+    lua_State *L;
+    /* replies waiting to be written */
+    GString *pending;
+    /* event sources reading requests and writing replies */
+    guint in_id, out_id;
+    /* the client sent everything, close once the replies are written */
+    gboolean done;
+} ipc_client_t;
+
+lua_class_t ipc_class;
+LUA_CLASS_FUNCS(ipc, ipc_class);
+
+/* the listening socket and its path */
+static GIOChannel *ipc_server;
+static gchar *ipc_server_path;
+
+/** Returns the default socket path: $XDG_RUNTIME_DIR/luapdf.sock or
+ * /tmp/luapdf-UID/luapdf.sock if XDG_RUNTIME_DIR isn't set. The directory in
+ * /tmp is created if necessary and must be owned by the user and not be
+ * accessible by anybody else, as another user could have created it first.
+ *
+ * \return A newly allocated path or NULL if there is no safe directory.
+ */
+gchar *
+ipc_default_path(void)
+{
+    const gchar *runtime = g_getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime)
+        return g_build_filename(runtime, "luapdf.sock", NULL);
+
+    struct stat st;
+    gchar *dir = g_strdup_printf("%s/luapdf-%d", g_get_tmp_dir(), getuid());
+    if (g_mkdir(dir, S_IRWXU) && errno != EEXIST) {
+        warn("unable to create %s: %s", dir, g_strerror(errno));
+        g_free(dir);
+        return NULL;
+    }
+    if (g_lstat(dir, &st) || !S_ISDIR(st.st_mode) || st.st_uid != getuid()
+            || (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        warn("not using the ipc socket, %s isn't a private directory", dir);
+        g_free(dir);
+        return NULL;
+    }
+    gchar *path = g_build_filename(dir, "luapdf.sock", NULL);
+    g_free(dir);
+    return path;
+}
+
+/* Checks that the process at the other end of a socket runs as the user */
+static gboolean
+ipc_peer_is_user(gint fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)
+        && cred.uid == getuid();
+}
+
+/* escape backslashes and newlines so that the text fits on one line */
+static void
+ipc_escape(GString *out, const gchar *text, gsize len)
+{
+    for (gsize i = 0; i < len; i++) {
+        if (text[i] == '\\')
+            g_string_append(out, "\\\\");
+        else if (text[i] == '\n')
+            g_string_append(out, "\\n");
+        else
+            g_string_append_c(out, text[i]);
+    }
+}
+
+/* undo ipc_escape in place */
+static void
+ipc_unescape(gchar *text)
+{
+    gchar *out = text;
+    for (; *text; text++) {
+        if (*text == '\\' && (text[1] == 'n' || text[1] == '\\'))
+            *out++ = (*++text == 'n') ? '\n' : '\\';
+        else
+            *out++ = *text;
+    }
+    *out = '\0';
+}
+
+/* Opens a socket and connects it to the given path, returns -1 on error. The
+ * socket and the listening process must belong to the user. */
+static gint
+ipc_connect(const gchar *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct stat st;
+    gint fd;
+
+    if (!path) {
+        errno = EACCES;
+        return -1;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    if (g_lstat(path, &st))
+        return -1;
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+        errno = EACCES;
+        return -1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    if (!ipc_peer_is_user(fd)) {
+        close(fd);
+        errno = EACCES;
+        return -1;
+    }
+    return fd;
+}
+
+/* Handles one request line of the client on the given socket, leaves the
+ * reply on the given string. The handlers learn whether the peer runs as the
+ * user, requests running code must not be served otherwise. */
+static void
+ipc_handle_request(lua_State *L, gint fd, gchar *line, GString *reply)
+{
+    const gchar *ret;
+    size_t len;
+
+    ipc_unescape(line);
+    lua_pushstring(L, line);
+    lua_pushboolean(L, ipc_peer_is_user(fd));
+    if (signal_object_emit(L, ipc_class.signals, "message", 2, 1)) {
+        if ((ret = lua_tolstring(L, -1, &len)))
+            ipc_escape(reply, ret, len);
+        lua_pop(L, 1);
+    }
+    g_string_append_c(reply, '\n');
+}
+
+static gboolean ipc_client_read_cb(GIOChannel *, GIOCondition, gpointer);
+
+static void
+ipc_client_free(ipc_client_t *c)
+{
+    if (c->in_id)
+        g_source_remove(c->in_id);
+    if (c->out_id)
+        g_source_remove(c->out_id);
+    g_io_channel_shutdown(c->channel, FALSE, NULL);
+    g_io_channel_unref(c->channel);
+    g_string_free(c->pending, TRUE);
+    g_slice_free(ipc_client_t, c);
+}
+
+/* Writes queued replies whenever the client accepts them. Replies are written
+ * to the socket directly, the channel is only buffered for reading lines. */
+static gboolean
+ipc_client_write_cb(GIOChannel *channel, GIOCondition cond, gpointer data)
+{
+    ipc_client_t *c = data;
+    ssize_t written = 0;
+
+    if (cond & G_IO_OUT) {
+        written = send(g_io_channel_unix_get_fd(channel), c->pending->str,
+                c->pending->len, MSG_NOSIGNAL);
+        if (written < 0 && (errno == EAGAIN || errno == EINTR))
+            return TRUE;
+    }
+    if (written <= 0) {
+        /* the client went away, drop the replies */
+        c->out_id = 0;
+        ipc_client_free(c);
+        return FALSE;
+    }
+    g_string_erase(c->pending, 0, written);
+    if (c->pending->len)
+        return TRUE;
+
+    c->out_id = 0;
+    if (c->done)
+        ipc_client_free(c);
+    /* continue reading requests held back by a full queue */
+    else if (!c->in_id)
+        c->in_id = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                ipc_client_read_cb, c);
+    return FALSE;
+}
+
+/* Reads the complete request lines of a client and queues the replies. The
+ * main loop is never blocked by a client that doesn't read its replies. */
+static gboolean
+ipc_client_read_cb(GIOChannel *channel, GIOCondition cond, gpointer data)
+{
+    ipc_client_t *c = data;
+    GIOStatus status = G_IO_STATUS_NORMAL;
+    gchar *line;
+    gsize len, term;
+
+    if (cond & G_IO_IN) {
+        while (c->pending->len < IPC_MAX_PENDING
+                && (status = g_io_channel_read_line(channel, &line, &len,
+                        &term, NULL)) == G_IO_STATUS_NORMAL) {
+            line[term] = '\0';
+            ipc_handle_request(c->L, g_io_channel_unix_get_fd(channel), line,
+                    c->pending);
+            g_free(line);
+        }
+    }
+
+    if (c->pending->len && !c->out_id)
+        c->out_id = g_io_add_watch(channel, G_IO_OUT | G_IO_HUP | G_IO_ERR,
+                ipc_client_write_cb, c);
+
+    /* G_IO_STATUS_AGAIN means we have to wait for the rest of a line */
+    if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR
+            || (!(cond & G_IO_IN) && cond & (G_IO_HUP | G_IO_ERR))) {
+        c->in_id = 0;
+        c->done = TRUE;
+        if (!c->out_id)
+            ipc_client_free(c);
+        return FALSE;
+    }
+
+    /* wait for the client to read its replies before reading more */
+    if (c->pending->len >= IPC_MAX_PENDING) {
+        c->in_id = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Accepts a new client connection */
+static gboolean
+ipc_accept_cb(GIOChannel *server, GIOCondition UNUSED(cond), gpointer data)
+{
+    ipc_client_t *c;
+    gint fd;
+
+    if ((fd = accept(g_io_channel_unix_get_fd(server), NULL, NULL)) < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            warn("unable to accept ipc connection: %s", g_strerror(errno));
+        return TRUE;
+    }
+
+    /* the socket is private, but don't rely on its permissions alone */
+    if (!ipc_peer_is_user(fd)) {
+        warn("rejecting ipc connection of another user");
+        close(fd);
+        return TRUE;
+    }
+
+    c = g_slice_new0(ipc_client_t);
+    c->L = data;
+    c->pending = g_string_new(NULL);
+    c->channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(c->channel, TRUE);
+    g_io_channel_set_encoding(c->channel, NULL, NULL);
+    g_io_channel_set_flags(c->channel, G_IO_FLAG_NONBLOCK, NULL);
+    c->in_id = g_io_add_watch(c->channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+            ipc_client_read_cb, c);
+    return TRUE;
+}
+
+/* remove the socket file when luapdf exits */
+static void
+ipc_cleanup(void)
+{
+    if (ipc_server_path)
+        g_unlink(ipc_server_path);
+}
+
+/** Starts listening for requests on a Unix domain socket. A stale socket
+ * file is replaced but another running instance is not.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack.
+ *
+ * \luastack
+ * \lparam path Optional socket path (default: \ref ipc_default_path).
+ * \lreturn true on success or nil and an error message.
+ */
+static gint
+luaH_ipc_listen(lua_State *L)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    gchar *path;
+    gint fd;
+
+    if (ipc_server)
+        luaL_error(L, "ipc server already listening on %s", ipc_server_path);
+
+    path = lua_isnoneornil(L, 1) ? ipc_default_path()
+        : g_strdup(luaL_checkstring(L, 1));
+    if (!path) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "no private directory for the ipc socket");
+        return 2;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "socket path too long: %s", path);
+        g_free(path);
+        return 2;
+    }
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    /* check for another instance, remove the socket if it's stale */
+    if ((fd = ipc_connect(path)) >= 0) {
+        close(fd);
+        lua_pushnil(L);
+        lua_pushfstring(L, "another instance is listening on %s", path);
+        g_free(path);
+        return 2;
+    }
+    g_unlink(path);
+
+    /* only the user may connect */
+    mode_t mask = umask(S_IRWXG | S_IRWXO);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+            || bind(fd, (struct sockaddr*) &addr, sizeof(addr))
+            || listen(fd, 16)) {
+        umask(mask);
+        lua_pushnil(L);
+        lua_pushfstring(L, "unable to listen on %s: %s", path,
+                g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        g_free(path);
+        return 2;
+    }
+    umask(mask);
+
+    ipc_server_path = path;
+    ipc_server = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(ipc_server, TRUE);
+    g_io_channel_set_flags(ipc_server, G_IO_FLAG_NONBLOCK, NULL);
+    g_io_add_watch(ipc_server, G_IO_IN, ipc_accept_cb, L);
+    atexit(ipc_cleanup);
+
+    lua_pushboolean(L, TRUE);
+    return 1;
+}
+
+/** Sends requests to a listening instance and waits for the replies.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack.
+ *
+ * \luastack
+ * \lparam request A request string or an array of request strings.
+ * \lparam path Optional socket path (default: \ref ipc_default_path).
+ * \lreturn The reply string (or an array of replies if an array of requests
+ * was given) or nil and an error message.
+ */
+static gint
+luaH_ipc_send(lua_State *L)
+{
+    struct timeval timeout = { .tv_sec = IPC_TIMEOUT };
+    gboolean batch = lua_istable(L, 1);
+    GString *buf = g_string_new(NULL);
+    gint fd, n = batch ? lua_objlen(L, 1) : 1, got = 0;
+    const gchar *text;
+    gchar *path, *err = NULL, chunk[4096];
+    ssize_t len;
+    size_t tlen;
+
+    if (!batch)
+        luaL_checkstring(L, 1);
+
+    /* build all request lines */
+    for (gint i = 1; i <= n; i++) {
+        if (batch)
+            lua_rawgeti(L, 1, i);
+        else
+            lua_pushvalue(L, 1);
+        if (!(text = lua_tolstring(L, -1, &tlen))) {
+            g_string_free(buf, TRUE);
+            return luaL_error(L, "ipc request %d is not a string", i);
+        }
+        ipc_escape(buf, text, tlen);
+        g_string_append_c(buf, '\n');
+        lua_pop(L, 1);
+    }
+
+    path = lua_isnoneornil(L, 2) ? ipc_default_path()
+        : g_strdup(luaL_checkstring(L, 2));
+    fd = ipc_connect(path);
+    g_free(path);
+    if (fd < 0) {
+        g_string_free(buf, TRUE);
+        lua_pushnil(L);
+        lua_pushstring(L, g_strerror(errno));
+        return 2;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (write(fd, buf->str, buf->len) != (ssize_t) buf->len)
+        err = g_strdup(g_strerror(errno));
+
+    /* read until every request got its reply line */
+    g_string_truncate(buf, 0);
+    while (!err && got < n) {
+        if ((len = read(fd, chunk, sizeof(chunk))) <= 0) {
+            err = g_strdup(len ? g_strerror(errno) : "connection closed");
+            break;
+        }
+        for (ssize_t i = 0; i < len; i++)
+            if (chunk[i] == '\n')
+                got++;
+        g_string_append_len(buf, chunk, len);
+    }
+    close(fd);
+
+    if (err) {
+        g_string_free(buf, TRUE);
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        g_free(err);
+        return 2;
+    }
+
+    /* push the replies */
+    gchar **lines = g_strsplit(buf->str, "\n", n + 1);
+    if (batch)
+        lua_createtable(L, n, 0);
+    for (gint i = 0; i < n && lines[i]; i++) {
+        ipc_unescape(lines[i]);
+        lua_pushstring(L, lines[i]);
+        if (batch)
+            lua_rawseti(L, -2, i + 1);
+    }
+    g_strfreev(lines);
+    g_string_free(buf, TRUE);
+    return 1;
+}
+
+/** Checks whether an instance is listening on a socket.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (1).
+ *
+ * \luastack
+ * \lparam path Optional socket path (default: \ref ipc_default_path).
+ * \lreturn A boolean.
+ */
+static gint
+luaH_ipc_is_running(lua_State *L)
+{
+    gchar *path = lua_isnoneornil(L, 1) ? ipc_default_path()
+        : g_strdup(luaL_checkstring(L, 1));
+    gint fd = ipc_connect(path);
+    g_free(path);
+    if (fd >= 0)
+        close(fd);
+    lua_pushboolean(L, fd >= 0);
+    return 1;
+}
+
+/** Returns the default socket path.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (1).
+ */
+static gint
+luaH_ipc_path(lua_State *L)
+{
+    if (ipc_server_path)
+        lua_pushstring(L, ipc_server_path);
+    else {
+        /* pushes nil without a safe directory */
+        gchar *path = ipc_default_path();
+        lua_pushstring(L, path);
+        g_free(path);
+    }
+    return 1;
+}
+
+void
+ipc_lib_setup(lua_State *L)
+{
+    static const struct luaL_reg ipc_lib[] =
+    {
+        LUA_CLASS_METHODS(ipc)
+        { "listen",     luaH_ipc_listen },
+        { "send",       luaH_ipc_send },
+        { "is_running", luaH_ipc_is_running },
+        { "path",       luaH_ipc_path },
+        { NULL,         NULL }
+    };
+
+    /* create signals array */
+    ipc_class.signals = signal_new();
+
+    /* export ipc lib */
+    luaH_openlib(L, "ipc", ipc_lib, ipc_lib);
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -18,14 +18,19 @@
  *
  */
 
+#include "common/memory.h"
+#include "common/profile.h"
 #include "common/signal.h"
+#include "common/trace.h"
 #include "clib/widget.h"
 #include "clib/luapdf.h"
 #include "luah.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 #include <gtk/gtk.h>
+#include <errno.h>
 #include <sys/wait.h>
 #include <time.h>
 
@@ -233,25 +238,11 @@ luaH_luapdf_spawn_sync(lua_State *L)
     gchar *_stdout = NULL;
     gchar *_stderr = NULL;
     gint rv;
-    struct sigaction sigact;
-    struct sigaction oldact;
 
     const gchar *command = luaL_checkstring(L, 1);
 
-    /* Note: we have to temporarily clear the SIGCHLD handler. Otherwise
-     * g_spawn_sync wouldn't be able to read subprocess' return value. */
-    sigact.sa_handler=SIG_DFL;
-    sigemptyset (&sigact.sa_mask);
-    sigact.sa_flags=0;
-    if (sigaction(SIGCHLD, &sigact, &oldact))
-        fatal("Can't clear SIGCHLD handler");
-
     g_spawn_command_line_sync(command, &_stdout, &_stderr, &rv, &e);
 
-    /* restore SIGCHLD handler */
-    if (sigaction(SIGCHLD, &oldact, NULL))
-        fatal("Can't restore SIGCHLD handler");
-
     /* raise error on spawn function error */
     if(e) {
         lua_pushstring(L, e->message);
@@ -302,6 +293,13 @@ void async_callback_handler(GPid pid, gint status, gpointer cb_ref)
     g_spawn_close_pid(pid);
 }
 
+/* Reaps a spawned child nobody waits for */
+static void
+async_reap_handler(GPid pid, gint UNUSED(status), gpointer UNUSED(data))
+{
+    g_spawn_close_pid(pid);
+}
+
 /** Executes a child program asynchronously (your program will not block waiting
  * for the child to exit).
  *
@@ -363,9 +361,11 @@ luaH_luapdf_spawn(lua_State *L)
             &e))
         goto spawn_error;
 
-    /* attach users Lua callback */
+    /* attach users Lua callback, reap the child in any case */
     if (cb_ref)
         g_child_watch_add(pid, async_callback_handler, cb_ref);
+    else
+        g_child_watch_add(pid, async_reap_handler, NULL);
 
     g_strfreev(argv);
     lua_pushnumber(L, pid);
@@ -396,6 +396,20 @@ luaH_luapdf_time(lua_State *L)
     return 1;
 }
 
+/** Get the time of a monotonic clock in microseconds. Unlike \ref
+ * luaH_luapdf_time it never jumps when the system time is changed, so it
+ * is the one to measure intervals with.
+ *
+ * \param L The Lua VM state.
+ * \return  The number of elements pushed on the stack (1).
+ */
+static gint
+luaH_luapdf_monotonic(lua_State *L)
+{
+    lua_pushnumber(L, l_monotonic_time());
+    return 1;
+}
+
 /** Wrapper around the execl POSIX function. The exec family of functions
  * replaces the current process image with a new process image. This function
  * will only return if there was an error with the execl call.
@@ -440,6 +454,16 @@ luaH_luapdf_index(lua_State *L)
       /* push boolean properties */
       PB_CASE(VERBOSE,          globalconf.verbose)
       PB_CASE(NOUNIQUE,         globalconf.nounique)
+      PB_CASE(PROFILE,          globalconf.profile)
+      PB_CASE(DAEMON,           globalconf.daemon)
+      PB_CASE(MODIFIER_MASK,    globalconf.modifier_mask)
+      /* push number properties */
+      PN_CASE(MEMORY_LIMIT,     memory_get_limit())
+      PN_CASE(HIBERNATE_TIMEOUT, memory_get_idle_timeout())
+      PN_CASE(MMAP_LIMIT,       globalconf.mmap_limit)
+
+      case L_TK_MEMORY:
+        return luaH_memory_push_stats(L);
 
       case L_TK_WINDOWS:
         lua_newtable(L);
@@ -475,6 +499,141 @@ luaH_luapdf_index(lua_State *L)
     return 0;
 }
 
+/** luapdf module newindex metamethod. Unknown keys are stored in the module
+ * table as usual.
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack.
+ */
+static gint
+luaH_luapdf_newindex(lua_State *L)
+{
+    const gchar *prop = luaL_checkstring(L, 2);
+    luapdf_token_t token = l_tokenize(prop);
+
+    switch(token) {
+      case L_TK_PROFILE:
+        globalconf.profile = luaH_checkboolean(L, 3);
+        break;
+
+      case L_TK_MODIFIER_MASK:
+        globalconf.modifier_mask = luaH_checkboolean(L, 3);
+        break;
+
+      case L_TK_HIBERNATE_TIMEOUT:
+      {
+        lua_Number timeout = luaL_checknumber(L, 3);
+        if (timeout < 0)
+            luaL_argerror(L, 3, "hibernate timeout must not be negative");
+        memory_set_idle_timeout(timeout);
+        break;
+      }
+
+      case L_TK_MMAP_LIMIT:
+      {
+        lua_Number limit = luaL_checknumber(L, 3);
+        if (limit < 0)
+            luaL_argerror(L, 3, "mmap limit must not be negative");
+        globalconf.mmap_limit = limit;
+        break;
+      }
+
+      case L_TK_MEMORY_LIMIT:
+      {
+        lua_Number limit = luaL_checknumber(L, 3);
+        if (limit < 0)
+            luaL_argerror(L, 3, "memory limit must not be negative");
+        memory_set_limit(limit);
+        break;
+      }
+
+      default:
+        lua_rawset(L, 1);
+        break;
+    }
+    return 0;
+}
+
+/** Returns the statistics collected by the Lua/C bridge profiler (see the
+ * \c luapdf.profile property and the \c --profile command line option).
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack (1).
+ *
+ * \luastack
+ * \lreturn An array of tables with the fields \c kind (\c "signal", \c
+ *          "handler", \c "index" or \c "newindex"), \c name, \c calls,
+ *          \c total and \c max (in seconds) sorted by total time spent.
+ *          Handler entries also contain the \c signal they are connected to.
+ */
+static gint
+luaH_luapdf_profile_report(lua_State *L)
+{
+    return luaH_profile_report_push(L);
+}
+
+/** Writes a human readable profiler report sorted by total time spent.
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam path Optional file to write the report to (defaults to stderr).
+ */
+static gint
+luaH_luapdf_profile_dump(lua_State *L)
+{
+    const gchar *path = luaL_optstring(L, 1, NULL);
+    FILE *f = stderr;
+    if (path && !(f = fopen(path, "w")))
+        return luaL_error(L, "unable to open %s: %s", path, g_strerror(errno));
+    profile_dump(f);
+    if (path)
+        fclose(f);
+    return 0;
+}
+
+/** Throws away all statistics collected by the profiler.
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack (0).
+ */
+static gint
+luaH_luapdf_profile_reset(lua_State *UNUSED(L))
+{
+    profile_reset();
+    return 0;
+}
+
+/** Begins a nested event in the startup trace (see --trace-startup).
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam name The name of the event.
+ * \lparam category Optional category of the event.
+ */
+static gint
+luaH_luapdf_trace_begin(lua_State *L)
+{
+    if (trace_enabled())
+        trace_begin(luaL_checkstring(L, 1), luaL_optstring(L, 2, "lua"));
+    return 0;
+}
+
+/** Ends the innermost event in the startup trace.
+ *
+ * \param  L The Lua VM state.
+ * \return   The number of elements pushed on stack (0).
+ */
+static gint
+luaH_luapdf_trace_end(lua_State *UNUSED(L))
+{
+    trace_end();
+    return 0;
+}
+
 /** Quit the main GTK loop.
  * \see http://developer.gnome.org/gtk/stable/gtk-General.html#gtk-main-quit
  *
@@ -527,24 +686,48 @@ idle_cb(gpointer func)
     return keep;
 }
 
+/* Returns the GLib priority of an idle priority class or number. GTK
+ * resizes and redraws at G_PRIORITY_HIGH_IDLE + 10 and + 20, so only "high"
+ * idle functions run before pending redraws. */
+static gint
+luaH_checkidlepriority(lua_State *L, gint idx)
+{
+    if (lua_isnoneornil(L, idx))
+        return G_PRIORITY_DEFAULT_IDLE;
+    if (lua_type(L, idx) == LUA_TNUMBER)
+        return lua_tointeger(L, idx);
+
+    const gchar *name = luaL_checkstring(L, idx);
+    if (!strcmp(name, "high"))
+        return G_PRIORITY_HIGH_IDLE;
+    if (!strcmp(name, "default"))
+        return G_PRIORITY_DEFAULT_IDLE;
+    if (!strcmp(name, "low"))
+        return G_PRIORITY_LOW;
+    return luaL_error(L, "unknown idle priority: %s", name);
+}
+
 /** Adds a function to be called whenever there are no higher priority GTK
  * events pending in the default main loop. If the function returns false it
  * is automatically removed from the list of event sources and will not be
  * called again.
- * \see http://developer.gnome.org/glib/unstable/glib-The-Main-Event-Loop.html#g-idle-add
+ * \see http://developer.gnome.org/glib/unstable/glib-The-Main-Event-Loop.html#g-idle-add-full
  *
  * \param  L The Lua VM state.
  * \return   The number of elements pushed on the stack (0).
  *
  * \luastack
  * \lparam func The callback function.
+ * \lparam priority Optional priority class ("high", "default" or "low") or
+ * GLib priority number.
  */
 static gint
 luaH_luapdf_idle_add(lua_State *L)
 {
     luaH_checkfunction(L, 1);
+    gint priority = luaH_checkidlepriority(L, 2);
     gpointer func = luaH_object_ref(L, 1);
-    g_idle_add(idle_cb, func);
+    g_idle_add_full(priority, idle_cb, func, NULL);
     return 0;
 }
 
@@ -579,6 +762,7 @@ luapdf_lib_setup(lua_State *L)
     {
         LUA_CLASS_METHODS(luapdf)
         { "__index",         luaH_luapdf_index },
+        { "__newindex",      luaH_luapdf_newindex },
         { "exec",            luaH_luapdf_exec },
         { "get_special_dir", luaH_luapdf_get_special_dir },
         { "quit",            luaH_luapdf_quit },
@@ -586,8 +770,14 @@ luapdf_lib_setup(lua_State *L)
         { "spawn",           luaH_luapdf_spawn },
         { "spawn_sync",      luaH_luapdf_spawn_sync },
         { "time",            luaH_luapdf_time },
+        { "monotonic",       luaH_luapdf_monotonic },
         { "idle_add",        luaH_luapdf_idle_add },
         { "idle_remove",     luaH_luapdf_idle_remove },
+        { "profile_dump",    luaH_luapdf_profile_dump },
+        { "profile_report",  luaH_luapdf_profile_report },
+        { "profile_reset",   luaH_luapdf_profile_reset },
+        { "trace_begin",     luaH_luapdf_trace_begin },
+        { "trace_end",       luaH_luapdf_trace_end },
         { NULL,              NULL }
     };
 
@@ -0,0 +1,423 @@
+/*
+ * clib/process.c - asynchronous child process class
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Unlike luapdf.spawn_sync a process object never blocks the main loop: the
+ * pipes of the child are watched with GIOChannels and every chunk of output
+ * is emitted as a "stdout" or "stderr" signal as soon as it arrives. Data
+ * written to stdin is queued and written whenever the pipe accepts it. The
+ * "exit" signal follows the last chunk of output. */
+
+#include "clib/process.h"
+#include "common/luaobject.h"
+#include "globalconf.h"
+#include "luah.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* bytes read from a pipe at once */
+#define PROCESS_CHUNK 4096
+
+typedef struct {
+    LUA_OBJECT_HEADER
+    /* keeps the object alive while the child runs */
+    gpointer ref;
+    /* the command and its arguments */
+    gchar **argv;
+    /* pid of the running child or 0 */
+    GPid pid;
+    /* pipes to the child, NULL once closed */
+    GIOChannel *in, *out, *err;
+    /* event source watching stdin while data is queued */
+    guint in_id;
+    /* data waiting to be written to stdin */
+    GString *pending;
+    /* close stdin once all queued data is written */
+    gboolean close_in;
+    /* the child has exited with status */
+    gboolean exited;
+    gint status;
+} lprocess_t;
+
+static lua_class_t process_class;
+LUA_OBJECT_FUNCS(process_class, lprocess_t, process)
+
+#define luaH_checkprocess(L, idx) luaH_checkudata(L, idx, &(process_class))
+
+static void
+process_close_stdin(lprocess_t *p)
+{
+    if (p->in_id)
+        g_source_remove(p->in_id);
+    p->in_id = 0;
+    if (p->in) {
+        g_io_channel_shutdown(p->in, FALSE, NULL);
+        g_io_channel_unref(p->in);
+        p->in = NULL;
+    }
+    if (p->pending)
+        g_string_truncate(p->pending, 0);
+    p->close_in = FALSE;
+}
+
+/* Emits "exit" once the child exited and both output pipes reached EOF, so
+ * that no output is delivered after the exit signal */
+static void
+process_check_finished(lprocess_t *p)
+{
+    lua_State *L = globalconf.L;
+    gint status = p->status;
+
+    if (!p->exited || p->out || p->err)
+        return;
+
+    process_close_stdin(p);
+    p->pid = 0;
+    p->exited = FALSE;
+
+    luaH_object_push(L, p->ref);
+    if (WIFEXITED(status)) {
+        lua_pushliteral(L, "exit");
+        lua_pushinteger(L, WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        lua_pushliteral(L, "signal");
+        lua_pushinteger(L, WTERMSIG(status));
+    } else {
+        lua_pushliteral(L, "unknown");
+        lua_pushinteger(L, -1);
+    }
+    luaH_object_emit_signal(L, -3, "exit", 2, 0);
+    lua_pop(L, 1);
+
+    /* allow process to be garbage collected (unless it was restarted) */
+    if (!p->pid) {
+        luaH_object_unref(L, p->ref);
+        p->ref = NULL;
+    }
+}
+
+static void
+process_child_watch_cb(GPid pid, gint status, gpointer data)
+{
+    lprocess_t *p = data;
+    g_spawn_close_pid(pid);
+    p->exited = TRUE;
+    p->status = status;
+    process_check_finished(p);
+}
+
+/* Emits every chunk read from stdout or stderr */
+static gboolean
+process_read_cb(GIOChannel *channel, GIOCondition UNUSED(cond), gpointer data)
+{
+    lprocess_t *p = data;
+    lua_State *L = globalconf.L;
+    gboolean is_out = channel == p->out;
+    gchar buf[PROCESS_CHUNK];
+    gsize len = 0;
+
+    GIOStatus status = g_io_channel_read_chars(channel, buf, sizeof(buf),
+            &len, NULL);
+
+    if (len) {
+        luaH_object_push(L, p->ref);
+        lua_pushlstring(L, buf, len);
+        luaH_object_emit_signal(L, -2, is_out ? "stdout" : "stderr", 1, 0);
+        lua_pop(L, 1);
+    }
+
+    if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN)
+        return TRUE;
+
+    /* EOF or error, the pipe is done */
+    g_io_channel_shutdown(channel, FALSE, NULL);
+    g_io_channel_unref(channel);
+    if (is_out)
+        p->out = NULL;
+    else
+        p->err = NULL;
+    process_check_finished(p);
+    return FALSE;
+}
+
+/* Writes queued data to stdin whenever the pipe accepts it */
+static gboolean
+process_write_cb(GIOChannel *channel, GIOCondition cond, gpointer data)
+{
+    lprocess_t *p = data;
+    gsize written = 0;
+    GIOStatus status = G_IO_STATUS_ERROR;
+
+    if (cond & G_IO_OUT)
+        status = g_io_channel_write_chars(channel, p->pending->str,
+                p->pending->len, &written, NULL);
+    g_string_erase(p->pending, 0, written);
+
+    if (status == G_IO_STATUS_ERROR || status == G_IO_STATUS_EOF) {
+        /* the child closed its stdin, drop the queued data */
+        p->in_id = 0;
+        process_close_stdin(p);
+        return FALSE;
+    }
+
+    if (p->pending->len)
+        return TRUE;
+
+    p->in_id = 0;
+    if (p->close_in)
+        process_close_stdin(p);
+    return FALSE;
+}
+
+/* set up a non-blocking binary channel for a pipe */
+static GIOChannel *
+process_channel_new(gint fd)
+{
+    GIOChannel *channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    g_io_channel_set_encoding(channel, NULL, NULL);
+    g_io_channel_set_buffered(channel, FALSE);
+    g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+    return channel;
+}
+
+static gint
+luaH_process_gc(lua_State *L)
+{
+    lprocess_t *p = luaH_checkprocess(L, 1);
+    g_strfreev(p->argv);
+    if (p->pending)
+        g_string_free(p->pending, TRUE);
+    return luaH_object_gc(L);
+}
+
+static gint
+luaH_process_new(lua_State *L)
+{
+    luaH_class_new(L, &process_class);
+    return 1;
+}
+
+/** Starts the child process.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ */
+static gint
+luaH_process_start(lua_State *L)
+{
+    lprocess_t *p = luaH_checkprocess(L, 1);
+    gint in, out, err;
+    GError *e = NULL;
+
+    if (!p->argv || !p->argv[0])
+        luaL_error(L, "command not set");
+    if (p->pid)
+        luaL_error(L, "process already running");
+
+    if (!g_spawn_async_with_pipes(NULL, p->argv, NULL,
+            G_SPAWN_DO_NOT_REAP_CHILD|G_SPAWN_SEARCH_PATH, NULL, NULL,
+            &p->pid, &in, &out, &err, &e)) {
+        p->pid = 0;
+        lua_pushstring(L, e->message);
+        g_clear_error(&e);
+        lua_error(L);
+    }
+
+    /* ensure process isn't collected while running */
+    if (!p->ref)
+        p->ref = luaH_object_ref(L, 1);
+
+    p->in = process_channel_new(in);
+    p->out = process_channel_new(out);
+    p->err = process_channel_new(err);
+    g_io_add_watch(p->out, G_IO_IN|G_IO_HUP|G_IO_ERR, process_read_cb, p);
+    g_io_add_watch(p->err, G_IO_IN|G_IO_HUP|G_IO_ERR, process_read_cb, p);
+    g_child_watch_add(p->pid, process_child_watch_cb, p);
+    return 0;
+}
+
+/** Queues data to be written to the stdin of the child.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam data The string to write.
+ */
+static gint
+luaH_process_write(lua_State *L)
+{
+    lprocess_t *p = luaH_checkprocess(L, 1);
+    size_t len;
+    const gchar *data = luaL_checklstring(L, 2, &len);
+
+    if (!p->in || p->close_in)
+        luaL_error(L, "stdin of process is closed");
+
+    if (!p->pending)
+        p->pending = g_string_sized_new(len);
+    g_string_append_len(p->pending, data, len);
+
+    if (!p->in_id && p->pending->len)
+        p->in_id = g_io_add_watch(p->in, G_IO_OUT|G_IO_HUP|G_IO_ERR,
+                process_write_cb, p);
+    return 0;
+}
+
+/** Closes the stdin of the child once all queued data is written.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ */
+static gint
+luaH_process_close_stdin(lua_State *L)
+{
+    lprocess_t *p = luaH_checkprocess(L, 1);
+    if (p->in_id)
+        p->close_in = TRUE;
+    else
+        process_close_stdin(p);
+    return 0;
+}
+
+/** Sends a signal to the child, SIGTERM by default.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (0).
+ *
+ * \luastack
+ * \lparam signal Optional signal number.
+ */
+static gint
+luaH_process_kill(lua_State *L)
+{
+    lprocess_t *p = luaH_checkprocess(L, 1);
+    gint sig = luaL_optint(L, 2, SIGTERM);
+    if (!p->pid || p->exited)
+        luaH_warn(L, "process not running");
+    else if (kill(p->pid, sig))
+        luaH_warn(L, "unable to kill process %d: %s", p->pid,
+                g_strerror(errno));
+    return 0;
+}
+
+static gint
+luaH_process_set_command(lua_State *L, lprocess_t *p)
+{
+    GError *e = NULL;
+    gchar **argv = NULL;
+
+    if (lua_istable(L, -1)) {
+        gint n = lua_objlen(L, -1);
+        argv = g_new0(gchar*, n + 1);
+        for (gint i = 0; i < n; i++) {
+            lua_rawgeti(L, -1, i + 1);
+            argv[i] = g_strdup(luaL_checkstring(L, -1));
+            lua_pop(L, 1);
+        }
+    } else if (!g_shell_parse_argv(luaL_checkstring(L, -1), NULL, &argv, &e)) {
+        lua_pushstring(L, e->message);
+        g_clear_error(&e);
+        lua_error(L);
+    }
+
+    g_strfreev(p->argv);
+    p->argv = argv;
+    return 0;
+}
+
+static gint
+luaH_process_get_command(lua_State *L, lprocess_t *p)
+{
+    gint n = p->argv ? g_strv_length(p->argv) : 0;
+    lua_createtable(L, n, 0);
+    for (gint i = 0; i < n; i++) {
+        lua_pushstring(L, p->argv[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+static gint
+luaH_process_get_pid(lua_State *L, lprocess_t *p)
+{
+    if (!p->pid)
+        return 0;
+    lua_pushinteger(L, p->pid);
+    return 1;
+}
+
+static gint
+luaH_process_get_running(lua_State *L, lprocess_t *p)
+{
+    lua_pushboolean(L, p->pid && !p->exited);
+    return 1;
+}
+
+void
+process_class_setup(lua_State *L)
+{
+    static const struct luaL_reg process_methods[] =
+    {
+        LUA_CLASS_METHODS(process)
+        { "__call", luaH_process_new },
+        { NULL, NULL }
+    };
+
+    static const struct luaL_reg process_meta[] =
+    {
+        LUA_OBJECT_META(process)
+        LUA_CLASS_META
+        { "start", luaH_process_start },
+        { "write", luaH_process_write },
+        { "close_stdin", luaH_process_close_stdin },
+        { "kill", luaH_process_kill },
+        { "__gc", luaH_process_gc },
+        { NULL, NULL },
+    };
+
+    luaH_class_setup(L, &process_class, "process",
+            (lua_class_allocator_t) process_new,
+            luaH_class_index_miss_property, luaH_class_newindex_miss_property,
+            process_methods, process_meta);
+
+    luaH_class_add_property(&process_class, L_TK_COMMAND,
+            (lua_class_propfunc_t) luaH_process_set_command,
+            (lua_class_propfunc_t) luaH_process_get_command,
+            (lua_class_propfunc_t) luaH_process_set_command);
+
+    luaH_class_add_property(&process_class, L_TK_PID,
+            NULL,
+            (lua_class_propfunc_t) luaH_process_get_pid,
+            NULL);
+
+    luaH_class_add_property(&process_class, L_TK_RUNNING,
+            NULL,
+            (lua_class_propfunc_t) luaH_process_get_running,
+            NULL);
+}
+
+#undef luaH_checkprocess
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
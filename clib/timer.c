@@ -22,30 +22,82 @@
 
 #include "clib/timer.h"
 #include "common/luaobject.h"
+#include "common/util.h"
 #include "globalconf.h"
 #include "luah.h"
 
 #include <glib.h>
 
+/* Timers with a tolerance don't get event sources of their own. They share
+ * a single source which fires at the latest time the most urgent of them
+ * may be run and then runs every timer that is due, so timers with similar
+ * deadlines wake luapdf up only once. Timers which tolerate a delay of a
+ * second or more use g_timeout_add_seconds, which GLib batches with the
+ * timers of other processes. */
+
 typedef struct {
     LUA_OBJECT_HEADER
     gpointer ref;
     int id;
     int interval;
+    /* milliseconds the timer may fire late to be batched with others */
+    int tolerance;
+    /* stop after the first timeout */
+    gboolean single_shot;
+    /* monotonic time (µs) of the next timeout of a coalesced timer */
+    gint64 deadline;
 } ltimer_t;
 
 static lua_class_t timer_class;
 LUA_OBJECT_FUNCS(timer_class, ltimer_t, timer)
 
 #define TIMER_STOPPED -1
+#define TIMER_COALESCED -2
 
 #define luaH_checktimer(L, idx) luaH_checkudata(L, idx, &(timer_class))
 
+/* the running coalesced timers and their shared event source */
+static GPtrArray *coalesced;
+static guint coalesce_id;
+static gint64 coalesce_at;
+
+static gboolean timer_coalesce_cb(gpointer);
+
+/* (Re)schedule the shared source for the most urgent coalesced timer */
+static void
+timer_coalesce_schedule(void)
+{
+    gint64 wake = G_MAXINT64;
+
+    for (guint i = 0; coalesced && i < coalesced->len; i++) {
+        ltimer_t *t = coalesced->pdata[i];
+        wake = MIN(wake, t->deadline + (gint64) t->tolerance * 1000);
+    }
+
+    if (coalesce_id && wake == coalesce_at)
+        return;
+    if (coalesce_id)
+        g_source_remove(coalesce_id);
+    coalesce_id = 0;
+
+    if (wake != G_MAXINT64) {
+        gint64 delay = wake - l_monotonic_time();
+        coalesce_at = wake;
+        coalesce_id = g_timeout_add(delay > 0 ? (delay + 999) / 1000 : 0,
+                timer_coalesce_cb, NULL);
+    }
+}
+
 static void
 luaH_timer_destroy(lua_State *L, ltimer_t *timer) {
-    GSource *source = g_main_context_find_source_by_id(NULL, timer->id);
-    if (source != NULL)
-        g_source_destroy(source);
+    if (timer->id == TIMER_COALESCED) {
+        g_ptr_array_remove_fast(coalesced, timer);
+        timer_coalesce_schedule();
+    } else {
+        GSource *source = g_main_context_find_source_by_id(NULL, timer->id);
+        if (source != NULL)
+            g_source_destroy(source);
+    }
 
     /* allow timer to be garbage collected */
     luaH_object_unref(L, timer->ref);
@@ -54,13 +106,69 @@ luaH_timer_destroy(lua_State *L, ltimer_t *timer) {
     timer->id = TIMER_STOPPED;
 }
 
+/* Emits "timeout", the timer object is on top of the stack */
+static void
+timer_emit_timeout(lua_State *L, ltimer_t *timer)
+{
+    /* stopping a single-shot timer first allows restarting it in the
+     * handler, the object on the stack keeps it alive */
+    if (timer->single_shot)
+        luaH_timer_destroy(L, timer);
+    luaH_object_emit_signal(L, -1, "timeout", 0, 0);
+}
+
 static gboolean
 timer_handle_timeout(gpointer data)
 {
     ltimer_t *timer = (ltimer_t *) data;
-    luaH_object_push(globalconf.L, timer->ref);
-    luaH_object_emit_signal(globalconf.L, -1, "timeout", 1, 0);
-    return TRUE;
+    lua_State *L = globalconf.L;
+    gboolean single_shot = timer->single_shot;
+    luaH_object_push(L, timer->ref);
+    timer_emit_timeout(L, timer);
+    lua_pop(L, 1);
+    /* the source was destroyed already */
+    return !single_shot;
+}
+
+/* Runs all coalesced timers that are due */
+static gboolean
+timer_coalesce_cb(gpointer UNUSED(data))
+{
+    lua_State *L = globalconf.L;
+    gint64 now = l_monotonic_time();
+    gint top = lua_gettop(L);
+    GPtrArray *due = g_ptr_array_new();
+
+    coalesce_id = 0;
+
+    /* collect the due timers first, handlers may start or stop timers */
+    for (guint i = 0; i < coalesced->len; i++) {
+        ltimer_t *t = coalesced->pdata[i];
+        if (t->deadline > now)
+            continue;
+        g_ptr_array_add(due, t);
+        /* keeps the object alive while the handlers run */
+        luaL_checkstack(L, 1, "too many timers");
+        luaH_object_push(L, t->ref);
+    }
+
+    for (guint i = 0; i < due->len; i++) {
+        ltimer_t *t = due->pdata[i];
+        /* skip timers stopped (and maybe restarted) by an earlier handler */
+        if (t->id != TIMER_COALESCED || t->deadline > now)
+            continue;
+        t->deadline += (gint64) t->interval * 1000;
+        if (t->deadline <= now)
+            t->deadline = now + (gint64) t->interval * 1000;
+        lua_pushvalue(L, top + 1 + i);
+        timer_emit_timeout(L, t);
+        lua_pop(L, 1);
+    }
+
+    lua_settop(L, top);
+    g_ptr_array_free(due, TRUE);
+    timer_coalesce_schedule();
+    return FALSE;
 }
 
 static int
@@ -79,12 +187,27 @@ luaH_timer_start(lua_State *L)
     if (!timer->interval)
         luaL_error(L, "interval not set");
 
-    if (timer->id == TIMER_STOPPED) {
-        /* ensure timer isn't collected while running */
-        timer->ref = luaH_object_ref(L, 1);
-        timer->id = g_timeout_add(timer->interval, timer_handle_timeout, timer);
-    } else
+    if (timer->id != TIMER_STOPPED) {
         luaH_warn(L, "timer already started");
+        return 0;
+    }
+
+    /* ensure timer isn't collected while running */
+    timer->ref = luaH_object_ref(L, 1);
+
+    if (timer->tolerance >= 1000)
+        /* never earlier than the interval, only later */
+        timer->id = g_timeout_add_seconds(MAX(1, (timer->interval + 999) / 1000),
+                timer_handle_timeout, timer);
+    else if (timer->tolerance > 0) {
+        if (!coalesced)
+            coalesced = g_ptr_array_new();
+        timer->id = TIMER_COALESCED;
+        timer->deadline = l_monotonic_time() + (gint64) timer->interval * 1000;
+        g_ptr_array_add(coalesced, timer);
+        timer_coalesce_schedule();
+    } else
+        timer->id = g_timeout_add(timer->interval, timer_handle_timeout, timer);
     return 0;
 }
 
@@ -113,6 +236,34 @@ luaH_timer_get_interval(lua_State *L, ltimer_t *timer)
     return 1;
 }
 
+static int
+luaH_timer_set_tolerance(lua_State *L, ltimer_t *timer)
+{
+    timer->tolerance = MAX(0, luaL_checkint(L, -1));
+    return 0;
+}
+
+static int
+luaH_timer_get_tolerance(lua_State *L, ltimer_t *timer)
+{
+    lua_pushinteger(L, timer->tolerance);
+    return 1;
+}
+
+static int
+luaH_timer_set_single_shot(lua_State *L, ltimer_t *timer)
+{
+    timer->single_shot = luaH_checkboolean(L, -1);
+    return 0;
+}
+
+static int
+luaH_timer_get_single_shot(lua_State *L, ltimer_t *timer)
+{
+    lua_pushboolean(L, timer->single_shot);
+    return 1;
+}
+
 static int
 luaH_timer_get_started(lua_State *L, ltimer_t *timer)
 {
@@ -150,6 +301,16 @@ timer_class_setup(lua_State *L)
             (lua_class_propfunc_t) luaH_timer_get_interval,
             (lua_class_propfunc_t) luaH_timer_set_interval);
 
+    luaH_class_add_property(&timer_class, L_TK_TOLERANCE,
+            (lua_class_propfunc_t) luaH_timer_set_tolerance,
+            (lua_class_propfunc_t) luaH_timer_get_tolerance,
+            (lua_class_propfunc_t) luaH_timer_set_tolerance);
+
+    luaH_class_add_property(&timer_class, L_TK_SINGLE_SHOT,
+            (lua_class_propfunc_t) luaH_timer_set_single_shot,
+            (lua_class_propfunc_t) luaH_timer_get_single_shot,
+            (lua_class_propfunc_t) luaH_timer_set_single_shot);
+
     luaH_class_add_property(&timer_class, L_TK_STARTED,
             NULL,
             (lua_class_propfunc_t) luaH_timer_get_started,
@@ -20,6 +20,7 @@
  */
 
 #include "clib/widget.h"
+#include "common/profile.h"
 
 widget_info_t widgets_list[] = {
   { L_TK_ENTRY,     "entry",    widget_entry    },
@@ -84,14 +85,24 @@ luaH_widget_index(lua_State *L)
 {
     const char *prop = luaL_checkstring(L, 2);
     luapdf_token_t token = l_tokenize(prop);
+    gint64 start = PROFILE_START();
+    gint ret;
 
     /* Try standard method */
     if(luaH_class_index(L))
-        return 1;
+        ret = 1;
+    else {
+        /* Then call special widget index */
+        widget_t *widget = luaH_checkudata(L, 1, &widget_class);
+        ret = widget->index ? widget->index(L, token) : 0;
+    }
 
-    /* Then call special widget index */
-    widget_t *widget = luaH_checkudata(L, 1, &widget_class);
-    return widget->index ? widget->index(L, token) : 0;
+    if (start) {
+        widget_t *widget = luaH_checkudata(L, 1, &widget_class);
+        profile_record_property(PROFILE_INDEX,
+                widget->info ? widget->info->name : "widget", prop, start);
+    }
+    return ret;
 }
 
 /** Generic widget newindex.
@@ -103,13 +114,20 @@ luaH_widget_newindex(lua_State *L)
 {
     const char *prop = luaL_checkstring(L, 2);
     luapdf_token_t token = l_tokenize(prop);
+    gint64 start = PROFILE_START();
+    gint ret;
 
     /* Try standard method */
     luaH_class_newindex(L);
 
     /* Then call special widget newindex */
     widget_t *widget = luaH_checkudata(L, 1, &widget_class);
-    return widget->newindex ? widget->newindex(L, token) : 0;
+    ret = widget->newindex ? widget->newindex(L, token) : 0;
+
+    if (start)
+        profile_record_property(PROFILE_NEWINDEX,
+                widget->info ? widget->info->name : "widget", prop, start);
+    return ret;
 }
 
 static gint
@@ -0,0 +1,291 @@
+/*
+ * client/luapdfc.c - luapdf ipc client
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* A tiny client for the ipc socket of a running luapdf instance (see
+ * clib/ipc.c and lib/remote.lua). It deliberately uses nothing but libc so
+ * that it starts in a fraction of the time of GTK and Lua.
+ *
+ * All requests are sent over one connection before the replies are read, so
+ * opening many documents or running a batch of commands costs a single round
+ * trip. If no instance is listening and only documents were given, luapdf
+ * itself is started with the same documents.
+ *
+ * Like the server, it only talks to a socket and a process of the user. */
+
+/* struct ucred */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* seconds to wait for the replies */
+#define TIMEOUT 5
+
+/* a growing character buffer */
+typedef struct {
+    char *data;
+    size_t len, size;
+} buf_t;
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s SOCKET] [-w] [-c REQUEST]... [-e LUA]... "
+            "[-b] [FILE...]\n"
+            "  -s SOCKET   socket of the luapdf instance\n"
+            "  -w          open the files in new windows\n"
+            "  -c REQUEST  send a request, e.g. \"paths\" or \"page\"\n"
+            "  -e LUA      run Lua code in the instance\n"
+            "  -b          send the lines of stdin as requests\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+/* $XDG_RUNTIME_DIR/luapdf.sock or /tmp/luapdf-UID/luapdf.sock, like the
+ * server. The server checks that the directory is private. */
+static void
+default_path(char *path, size_t len)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR"), *tmp = getenv("TMPDIR");
+    if (dir && *dir)
+        snprintf(path, len, "%s/luapdf.sock", dir);
+    else
+        snprintf(path, len, "%s/luapdf-%d/luapdf.sock",
+                tmp && *tmp ? tmp : "/tmp", (int) getuid());
+}
+
+/* make room for at least n more characters */
+static void
+grow(buf_t *b, size_t n)
+{
+    if (b->len + n + 1 <= b->size)
+        return;
+    while (b->len + n + 1 > b->size)
+        b->size = b->size ? b->size * 2 : 256;
+    if (!(b->data = realloc(b->data, b->size))) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* append text, escaping backslashes and newlines if asked to */
+static void
+append(buf_t *b, const char *text, int escape)
+{
+    for (; *text; text++) {
+        grow(b, 2);
+        if (escape && (*text == '\\' || *text == '\n')) {
+            b->data[b->len++] = '\\';
+            b->data[b->len++] = *text == '\n' ? 'n' : '\\';
+        } else
+            b->data[b->len++] = *text;
+    }
+}
+
+/* append one request line */
+static void
+request(buf_t *b, int *n, const char *cmd, const char *arg)
+{
+    append(b, cmd, 0);
+    if (arg) {
+        append(b, " ", 0);
+        append(b, arg, 1);
+    }
+    append(b, "\n", 0);
+    (*n)++;
+}
+
+/* undo the escaping of backslashes and newlines in place */
+static void
+unescape(char *text)
+{
+    char *out = text;
+    for (; *text; text++) {
+        if (*text == '\\' && (text[1] == 'n' || text[1] == '\\'))
+            *out++ = (*++text == 'n') ? '\n' : '\\';
+        else
+            *out++ = *text;
+    }
+    *out = '\0';
+}
+
+static int
+connect_to(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct timeval timeout = { .tv_sec = TIMEOUT };
+    struct ucred cred;
+    socklen_t clen = sizeof(cred);
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* the socket and the instance must belong to the user */
+    if (lstat(path, &st))
+        return -1;
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+        errno = EACCES;
+        return -1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &clen)
+            || cred.uid != getuid()) {
+        close(fd);
+        errno = EACCES;
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+/* print a reply: results go to stdout, errors to stderr */
+static int
+print_reply(char *line)
+{
+    unescape(line);
+    if (*line == '+') {
+        if (line[1])
+            printf("%s\n", line + 1);
+        return 0;
+    }
+    fprintf(stderr, "%s\n", *line == '-' ? line + 1 : line);
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char path[PATH_MAX], real[PATH_MAX], *line = NULL, *nl;
+    buf_t req = { 0 }, reply = { 0 };
+    const char *cmd = "tabopen";
+    int opt, fd, n = 0, failed = 0, only_files = 1, batch = 0;
+    size_t llen = 0, done = 0;
+    ssize_t got;
+
+    default_path(path, sizeof(path));
+    while ((opt = getopt(argc, argv, "s:wc:e:bh")) != -1) {
+        switch (opt) {
+          case 's':
+            snprintf(path, sizeof(path), "%s", optarg);
+            break;
+          case 'w':
+            cmd = "winopen";
+            break;
+          case 'c':
+            append(&req, optarg, 1);
+            append(&req, "\n", 0);
+            n++;
+            only_files = 0;
+            break;
+          case 'e':
+            request(&req, &n, "eval", optarg);
+            only_files = 0;
+            break;
+          case 'b':
+            batch = 1;
+            only_files = 0;
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    /* one request per line of stdin */
+    while (batch && (got = getline(&line, &llen, stdin)) > 0) {
+        if (line[got - 1] == '\n')
+            line[--got] = '\0';
+        if (!got)
+            continue;
+        append(&req, line, 0);
+        append(&req, "\n", 0);
+        n++;
+    }
+    free(line);
+
+    /* one request per file, or a new window without any requests */
+    for (int i = optind; i < argc; i++)
+        request(&req, &n, cmd, realpath(argv[i], real) ? real : argv[i]);
+    if (!n)
+        request(&req, &n, "winopen", NULL);
+
+    /* start luapdf instead if no instance is listening */
+    if ((fd = connect_to(path)) < 0) {
+        if (only_files) {
+            argv[optind - 1] = "luapdf";
+            execvp("luapdf", argv + optind - 1);
+        }
+        fprintf(stderr, "%s: unable to connect to %s: %s\n", argv[0], path,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (write(fd, req.data, req.len) != (ssize_t) req.len) {
+        fprintf(stderr, "%s: write: %s\n", argv[0], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* every request gets one reply line */
+    while (n > 0) {
+        grow(&reply, 4096);
+        if ((got = read(fd, reply.data + reply.len, 4096)) <= 0)
+            break;
+        reply.len += got;
+        reply.data[reply.len] = '\0';
+        while (n > 0 && (nl = strchr(reply.data + done, '\n'))) {
+            *nl = '\0';
+            failed |= print_reply(reply.data + done);
+            done = nl + 1 - reply.data;
+            n--;
+        }
+        /* drop the replies printed so far */
+        memmove(reply.data, reply.data + done, reply.len - done + 1);
+        reply.len -= done;
+        done = 0;
+    }
+    close(fd);
+    free(req.data);
+    free(reply.data);
+
+    if (n > 0) {
+        fprintf(stderr, "%s: no reply from %s\n", argv[0], path);
+        return EXIT_FAILURE;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
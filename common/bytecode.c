@@ -0,0 +1,217 @@
+/*
+ * bytecode.c - precompiled Lua chunk cache
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Chunks loaded from source are dumped to
+ * $XDG_CACHE_HOME/luapdf/bytecode/ and loaded from there on the next start
+ * as long as the source file didn't change. There is one cache file per
+ * source file, which is overwritten when the source changes, so the cache
+ * doesn't grow. */
+
+#include "common/bytecode.h"
+#include "common/util.h"
+#include "globalconf.h"
+
+#include <glib/gstdio.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* The bytecode format differs between Lua and LuaJIT (and their versions),
+ * config.mk passes the pkg-config name and version of the VM in use. */
+#ifndef LUA_VM_VERSION
+#define LUA_VM_VERSION "unknown"
+#endif
+#define BYTECODE_VM_VERSION LUA_VM_VERSION " " LUA_RELEASE
+
+/* Returns the path of the cache file for a source file or NULL if the source
+ * file can't be found. The name of the cache file depends on the real path of
+ * the source file and the version of the Lua VM. `stamp` is set to the first
+ * line of a valid cache file: the size and modification time (with
+ * nanoseconds) of the source file. */
+static gchar *
+bytecode_cache_path(const gchar *path, gchar **stamp)
+{
+    struct stat st;
+    gchar *real, *key, *sum, *name, *ret;
+
+    if (g_stat(path, &st) || !(real = realpath(path, NULL)))
+        return NULL;
+
+    key = g_strdup_printf("%s\n%s", real, BYTECODE_VM_VERSION);
+    sum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    name = g_strconcat(sum, ".luac", NULL);
+    ret = g_build_filename(globalconf.cache_dir, "bytecode", name, NULL);
+    *stamp = g_strdup_printf("%" G_GINT64_FORMAT " %" G_GINT64_FORMAT ".%09ld\n",
+            (gint64) st.st_size, (gint64) st.st_mtim.tv_sec,
+            (glong) st.st_mtim.tv_nsec);
+
+    free(real);
+    g_free(key);
+    g_free(sum);
+    g_free(name);
+    return ret;
+}
+
+static gint
+bytecode_writer(lua_State *UNUSED(L), const void *p, size_t sz, void *ud)
+{
+    g_string_append_len((GString*) ud, p, sz);
+    return 0;
+}
+
+/* Writes the chunk on top of the stack to the cache file, after the stamp of
+ * the source file */
+static void
+bytecode_cache_write(lua_State *L, const gchar *cache, const gchar *stamp)
+{
+    GString *buf = g_string_new(stamp);
+    GError *error = NULL;
+    gchar *dir;
+
+    if (lua_dump(L, bytecode_writer, buf) == 0) {
+        dir = g_path_get_dirname(cache);
+        g_mkdir_with_parents(dir, 0771);
+        g_free(dir);
+        if (!g_file_set_contents(cache, buf->str, buf->len, &error)) {
+            debug("unable to write bytecode cache: %s", error->message);
+            g_error_free(error);
+        }
+    }
+    g_string_free(buf, TRUE);
+}
+
+/** Loads a Lua file like \c luaL_loadfile but from the bytecode cache if a
+ * precompiled chunk of the unchanged file exists. Chunks loaded from source
+ * are added to the cache.
+ *
+ * \param L The Lua VM state.
+ * \param path The path of the Lua source file.
+ * \return 0 with the chunk on the stack or a \c luaL_loadfile error code
+ * with the error message on the stack.
+ */
+gint
+luaH_loadfile_cached(lua_State *L, const gchar *path)
+{
+    gchar *cache, *stamp, *contents, *chunkname;
+    gsize len, n;
+    gint ret;
+
+    if (globalconf.nobytecode || !(cache = bytecode_cache_path(path, &stamp)))
+        return luaL_loadfile(L, path);
+
+    /* the cache file is stale if the stamp differs */
+    n = strlen(stamp);
+    if (g_file_get_contents(cache, &contents, &len, NULL)) {
+        ret = -1;
+        if (len > n && !strncmp(contents, stamp, n)) {
+            chunkname = g_strconcat("@", path, NULL);
+            ret = luaL_loadbuffer(L, contents + n, len - n, chunkname);
+            g_free(chunkname);
+        }
+        g_free(contents);
+        if (!ret) {
+            debug("loaded bytecode of %s from %s", path, cache);
+            g_free(stamp);
+            g_free(cache);
+            return 0;
+        }
+        /* broken cache file, fall back to the source */
+        if (ret > 0)
+            lua_pop(L, 1);
+    }
+
+    if (!(ret = luaL_loadfile(L, path)))
+        bytecode_cache_write(L, cache, stamp);
+    g_free(stamp);
+    g_free(cache);
+    return ret;
+}
+
+/* Searches package.path for a module like the standard Lua loader, but loads
+ * the module through the bytecode cache. */
+static gint
+luaH_bytecode_loader(lua_State *L)
+{
+    const gchar *name = luaL_checkstring(L, 1);
+    gchar *file = g_strdup(name), **templates, *path = NULL;
+
+    g_strdelimit(file, ".", G_DIR_SEPARATOR);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    templates = g_strsplit(luaL_optstring(L, -1, ""), LUA_PATHSEP, -1);
+    lua_pop(L, 2);
+
+    for (gchar **t = templates; *t && !path; t++) {
+        gchar **parts = g_strsplit(*t, LUA_PATH_MARK, -1);
+        gchar *candidate = g_strjoinv(file, parts);
+        if (**t && g_file_test(candidate, G_FILE_TEST_IS_REGULAR))
+            path = candidate;
+        else
+            g_free(candidate);
+        g_strfreev(parts);
+    }
+    g_strfreev(templates);
+    g_free(file);
+
+    /* let the standard loader report where it looked */
+    if (!path) {
+        lua_pushliteral(L, "");
+        return 1;
+    }
+
+    if (luaH_loadfile_cached(L, path)) {
+        lua_pushfstring(L, "error loading module '%s' from file '%s':\n\t%s",
+                name, path, lua_tostring(L, -1));
+        g_free(path);
+        return lua_error(L);
+    }
+    g_free(path);
+    return 1;
+}
+
+/** Installs the bytecode cache loader in front of the standard Lua file
+ * loader in \c package.loaders.
+ *
+ * \param L The Lua VM state.
+ */
+void
+luaH_bytecode_setup(lua_State *L)
+{
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaders");
+    if (!lua_istable(L, -1)) {
+        warn("package.loaders is not a table");
+        lua_pop(L, 2);
+        return;
+    }
+
+    /* shift all loaders after package.preload's up by one */
+    for (gint i = lua_objlen(L, -1); i >= 2; i--) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushcfunction(L, luaH_bytecode_loader);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 2);
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -20,6 +20,7 @@
  */
 
 #include "common/luaobject.h"
+#include "common/profile.h"
 
 /* Setup the object system at startup. */
 void
@@ -185,6 +186,13 @@ signal_object_emit(lua_State *L, signal_t *signals,
         const gchar *name, gint nargs, gint nret) {
 
     signal_array_t *sigfuncs = signal_lookup(signals, name);
+    /* fast path: nobody is listening */
+    if (!sigfuncs && !globalconf.profile) {
+        lua_pop(L, nargs);
+        return 0;
+    }
+    gint64 start = PROFILE_START(), hstart = 0;
+    const gchar *handler = NULL;
     debug("emitting \"%s\" with %d args and %d nret", name, nargs, nret);
     if(sigfuncs) {
         gint nbfunc = sigfuncs->len;
@@ -205,7 +213,13 @@ signal_object_emit(lua_State *L, signal_t *signals,
             lua_pushvalue(L, - nargs - nbfunc + i);
             /* remove this first function */
             lua_remove(L, - nargs - nbfunc - 1 + i);
+            if (start) {
+                handler = profile_handler_name(L, -1);
+                hstart = l_monotonic_time();
+            }
             luaH_dofunction(L, nargs, LUA_MULTRET);
+            if (start)
+                profile_record(PROFILE_HANDLER, handler, name, hstart);
             gint ret = lua_gettop(L) - stacksize + 1;
 
             /* Note that only if nret && ret will the signal execution stop */
@@ -227,6 +241,8 @@ signal_object_emit(lua_State *L, signal_t *signals,
                     }
                 }
 
+                if (start)
+                    profile_record(PROFILE_SIGNAL, name, NULL, start);
                 /* Return the number of returned arguments */
                 return ret;
             } else if (nret == 0) {
@@ -237,6 +253,8 @@ signal_object_emit(lua_State *L, signal_t *signals,
     }
     /* remove args */
     lua_pop(L, nargs);
+    if (start)
+        profile_record(PROFILE_SIGNAL, name, NULL, start);
     return 0;
 }
 
@@ -258,10 +276,17 @@ luaH_object_emit_signal(lua_State *L, gint oud,
     gint ret, top, bot = lua_gettop(L) - nargs + 1;
     gint oud_abs = luaH_absindex(L, oud);
     lua_object_t *obj = lua_touserdata(L, oud);
-    debug("emitting \"%s\" on %p with %d args and %d nret", name, obj, nargs, nret);
     if(!obj)
         luaL_error(L, "trying to emit signal on non-object");
     signal_array_t *sigfuncs = signal_lookup(obj->signals, name);
+    /* fast path: nobody is listening */
+    if (!sigfuncs && !globalconf.profile) {
+        lua_pop(L, nargs);
+        return 0;
+    }
+    gint64 start = PROFILE_START(), hstart = 0;
+    const gchar *handler = NULL;
+    debug("emitting \"%s\" on %p with %d args and %d nret", name, obj, nargs, nret);
     if(sigfuncs) {
         guint nbfunc = sigfuncs->len;
         luaL_checkstack(L, lua_gettop(L) + nbfunc + nargs + 2, "too much signal");
@@ -281,7 +306,13 @@ luaH_object_emit_signal(lua_State *L, gint oud,
             /* remove this first function */
             lua_remove(L, - nargs - nbfunc - 2 + i);
             top = lua_gettop(L) - 2 - nargs;
+            if (start) {
+                handler = profile_handler_name(L, -1);
+                hstart = l_monotonic_time();
+            }
             luaH_dofunction(L, nargs + 1, LUA_MULTRET);
+            if (start)
+                profile_record(PROFILE_HANDLER, handler, name, hstart);
             ret = lua_gettop(L) - top;
 
             /* Note that only if nret && ret will the signal execution stop */
@@ -300,6 +331,8 @@ luaH_object_emit_signal(lua_State *L, gint oud,
                 /* Remove all signal functions and args from the stack */
                 for (gint i = bot; i <= top; i++)
                     lua_remove(L, bot);
+                if (start)
+                    profile_record(PROFILE_SIGNAL, name, NULL, start);
                 /* Return the number of returned arguments */
                 return ret;
             } else if (nret == 0) {
@@ -309,6 +342,8 @@ luaH_object_emit_signal(lua_State *L, gint oud,
         }
     }
     lua_pop(L, nargs);
+    if (start)
+        profile_record(PROFILE_SIGNAL, name, NULL, start);
     return 0;
 }
 
@@ -142,11 +142,23 @@ gint luaH_object_emit_signal(lua_State *L, gint oud,
 static inline gint
 luaH_object_emit_property_signal(lua_State *L, gint oud)
 {
+    lua_object_t *obj = lua_touserdata(L, oud);
+    /* skip building the signal name if nobody is listening at all */
+    if (obj && signal_is_empty(obj->signals))
+        return 0;
+
     size_t len;
-    gchar *signame = g_strdup_printf("property::%s",
-        luaL_checklstring(L, oud + 1, &len));
-    luaH_object_emit_signal(L, oud, signame, 0, 0);
-    g_free(signame);
+    const gchar *prop = luaL_checklstring(L, oud + 1, &len);
+    gchar buf[64];
+    if (len + sizeof("property::") > sizeof(buf)) {
+        gchar *signame = g_strdup_printf("property::%s", prop);
+        luaH_object_emit_signal(L, oud, signame, 0, 0);
+        g_free(signame);
+        return 0;
+    }
+    memcpy(buf, "property::", sizeof("property::") - 1);
+    memcpy(buf + sizeof("property::") - 1, prop, len + 1);
+    luaH_object_emit_signal(L, oud, buf, 0, 0);
     return 0;
 }
 
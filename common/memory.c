@@ -0,0 +1,280 @@
+/*
+ * memory.c - process-wide memory governor
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "common/memory.h"
+#include "common/util.h"
+
+#include <lauxlib.h>
+
+/* All registered clients. */
+static GPtrArray *clients;
+/* Sum of the bytes charged to all clients. */
+static gsize total;
+/* Limit in bytes, 0 means unlimited. */
+static gsize limit = MEMORY_DEFAULT_LIMIT;
+/* Idle source of a pending collection. */
+static guint collect_id;
+/* Set while clients are being evicted. */
+static gboolean collecting;
+/* Seconds after which hidden clients are evicted completely, 0 disables. */
+static guint idle_timeout = MEMORY_DEFAULT_IDLE_TIMEOUT;
+/* Timeout source of the idle sweep. */
+static guint sweep_id;
+
+static void memory_start_sweep(void);
+
+/** Registers a new memory client.
+ *
+ * \param evict The eviction callback or \c NULL.
+ * \param visible The visibility callback or \c NULL.
+ * \param data User data passed to the callbacks.
+ * \return The new client, to be freed with \ref memory_client_free.
+ */
+memory_client_t *
+memory_client_new(memory_evict_func_t evict, memory_visible_func_t visible,
+        gpointer data)
+{
+    memory_client_t *c = g_new0(memory_client_t, 1);
+    c->evict = evict;
+    c->visible = visible;
+    c->data = data;
+    c->last_used = l_monotonic_time();
+    if (!clients) {
+        clients = g_ptr_array_new();
+        memory_start_sweep();
+    }
+    g_ptr_array_add(clients, c);
+    return c;
+}
+
+/** Unregisters a client and releases everything still charged to it.
+ *
+ * \param c The client.
+ */
+void
+memory_client_free(memory_client_t *c)
+{
+    if (!c)
+        return;
+    total -= c->bytes;
+    g_ptr_array_remove_fast(clients, c);
+    g_free(c);
+}
+
+static gboolean
+memory_collect_cb(gpointer UNUSED(data))
+{
+    collect_id = 0;
+    memory_collect();
+    return FALSE;
+}
+
+/* schedule a collection once the main loop is idle, so nothing is evicted
+ * from under a running render or Lua call */
+static void
+memory_schedule_collect(void)
+{
+    if (limit && total > limit && !collect_id && !collecting)
+        collect_id = g_idle_add(memory_collect_cb, NULL);
+}
+
+/** Charges bytes to a client or releases them if \c delta is negative.
+ *
+ * \param c The client.
+ * \param delta The number of bytes.
+ */
+void
+memory_charge(memory_client_t *c, gssize delta)
+{
+    if (delta < 0 && (gsize) -delta > c->bytes)
+        delta = -(gssize) c->bytes;
+    c->bytes += delta;
+    total += delta;
+    if (delta > 0)
+        memory_schedule_collect();
+}
+
+/** Marks a client as used right now.
+ *
+ * \param c The client.
+ */
+void
+memory_touch(memory_client_t *c)
+{
+    c->last_used = l_monotonic_time();
+}
+
+/** Sets the memory limit and evicts clients if it is exceeded.
+ *
+ * \param l The new limit in bytes, 0 disables eviction.
+ */
+void
+memory_set_limit(gsize l)
+{
+    limit = l;
+    memory_schedule_collect();
+}
+
+gsize
+memory_get_limit(void)
+{
+    return limit;
+}
+
+/* evict all hidden clients that have not been used for too long */
+static gboolean
+memory_sweep_cb(gpointer UNUSED(data))
+{
+    gint64 now = l_monotonic_time();
+    for (guint i = 0; clients && i < clients->len; i++) {
+        memory_client_t *c = clients->pdata[i];
+        if (!c->evict || !c->bytes || (c->visible && c->visible(c->data)))
+            continue;
+        if (now - c->last_used < (gint64) idle_timeout * 1000000)
+            continue;
+        debug("evicting idle client %s", NONULL(c->name));
+        for (gint l = MEMORY_CACHES; l < MEMORY_LEVEL_LAST; l++)
+            c->evict(c->data, l);
+    }
+    return TRUE;
+}
+
+static void
+memory_start_sweep(void)
+{
+    if (sweep_id)
+        g_source_remove(sweep_id);
+    sweep_id = 0;
+    /* check a few times per timeout, but at most once a second */
+    if (idle_timeout)
+        sweep_id = g_timeout_add_seconds(CLAMP(idle_timeout / 4, 1, 60),
+                memory_sweep_cb, NULL);
+}
+
+/** Sets the time after which hidden clients are evicted completely.
+ *
+ * \param seconds The timeout in seconds, 0 disables idle eviction.
+ */
+void
+memory_set_idle_timeout(guint seconds)
+{
+    idle_timeout = seconds;
+    memory_start_sweep();
+}
+
+guint
+memory_get_idle_timeout(void)
+{
+    return idle_timeout;
+}
+
+typedef struct {
+    memory_client_t *client;
+    gboolean visible;
+} memory_candidate_t;
+
+/* hidden clients come first, least recently used first */
+static gint
+memory_candidate_cmp(gconstpointer a, gconstpointer b)
+{
+    const memory_candidate_t *x = a, *y = b;
+    if (x->visible != y->visible)
+        return x->visible ? 1 : -1;
+    return (x->client->last_used > y->client->last_used) -
+        (x->client->last_used < y->client->last_used);
+}
+
+/** Evicts clients until the total is below the limit again. Hidden clients
+ * are evicted completely in LRU order before visible clients lose their
+ * caches. The pages of visible clients are never evicted, as they would be
+ * reloaded right away.
+ */
+void
+memory_collect(void)
+{
+    if (!limit || total <= limit || collecting)
+        return;
+
+    collecting = TRUE;
+    GArray *order = g_array_sized_new(FALSE, FALSE,
+            sizeof(memory_candidate_t), clients->len);
+    for (guint i = 0; i < clients->len; i++) {
+        memory_client_t *c = clients->pdata[i];
+        if (!c->evict)
+            continue;
+        memory_candidate_t m = { c, c->visible && c->visible(c->data) };
+        g_array_append_val(order, m);
+    }
+    g_array_sort(order, memory_candidate_cmp);
+
+    for (guint i = 0; i < order->len && total > limit; i++) {
+        memory_candidate_t *m = &g_array_index(order, memory_candidate_t, i);
+        for (gint l = MEMORY_CACHES; l < MEMORY_LEVEL_LAST && total > limit; l++) {
+            if (m->visible && l > MEMORY_CACHES)
+                break;
+            debug("evicting level %d of %s (%" G_GSIZE_FORMAT " bytes)", l,
+                    NONULL(m->client->name), m->client->bytes);
+            m->client->evict(m->client->data, l);
+        }
+    }
+
+    g_array_free(order, TRUE);
+    collecting = FALSE;
+}
+
+/** Pushes a table with the current memory statistics.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (1).
+ */
+gint
+luaH_memory_push_stats(lua_State *L)
+{
+    gint64 now = l_monotonic_time();
+    guint n = clients ? clients->len : 0;
+
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, total);
+    lua_setfield(L, -2, "total");
+    lua_pushnumber(L, limit);
+    lua_setfield(L, -2, "limit");
+
+    lua_createtable(L, n, 0);
+    for (guint i = 0; i < n; i++) {
+        memory_client_t *c = clients->pdata[i];
+        lua_createtable(L, 0, 4);
+        if (c->name) {
+            lua_pushstring(L, c->name);
+            lua_setfield(L, -2, "name");
+        }
+        lua_pushnumber(L, c->bytes);
+        lua_setfield(L, -2, "bytes");
+        lua_pushboolean(L, c->visible && c->visible(c->data));
+        lua_setfield(L, -2, "visible");
+        lua_pushnumber(L, (now - c->last_used) / 1e6);
+        lua_setfield(L, -2, "idle");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "clients");
+    return 1;
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
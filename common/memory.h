@@ -0,0 +1,82 @@
+/*
+ * memory.h - process-wide memory governor
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef LUAPDF_COMMON_MEMORY_H
+#define LUAPDF_COMMON_MEMORY_H
+
+#include <glib.h>
+#include <lua.h>
+
+/** The default memory limit in bytes (see \c luapdf.memory_limit). */
+#define MEMORY_DEFAULT_LIMIT (256 * 1024 * 1024)
+/** The default time in seconds after which hidden clients are evicted
+ * completely (see \c luapdf.hibernate_timeout). */
+#define MEMORY_DEFAULT_IDLE_TIMEOUT (30 * 60)
+
+/** What an eviction may throw away, from cheapest to most expensive to
+ * restore. */
+typedef enum {
+    /** Data derived from pages: rendered surfaces, text and search results. */
+    MEMORY_CACHES,
+    /** The Poppler page objects themselves. */
+    MEMORY_PAGES,
+    /** Everything that can be restored from disk (hibernation). */
+    MEMORY_DOCUMENT,
+    MEMORY_LEVEL_LAST,
+} memory_level_t;
+
+/** Releases the data of the given level held by the client. The client must
+ * uncharge the released bytes with \ref memory_charge. */
+typedef void (*memory_evict_func_t)(gpointer, memory_level_t);
+/** Returns \c TRUE if the client is currently shown to the user. */
+typedef gboolean (*memory_visible_func_t)(gpointer);
+
+/** Bookkeeping for one consumer of memory, usually a document. */
+typedef struct {
+    /** A name for the statistics, e.g. the document path. */
+    const gchar *name;
+    /** Bytes currently charged to the client. */
+    gsize bytes;
+    /** Monotonic time of the last use in microseconds. */
+    gint64 last_used;
+    /** Eviction callback or \c NULL if the client can not be evicted. */
+    memory_evict_func_t evict;
+    /** Visibility callback or \c NULL if the client is never visible. */
+    memory_visible_func_t visible;
+    /** User data passed to the callbacks. */
+    gpointer data;
+} memory_client_t;
+
+memory_client_t *memory_client_new(memory_evict_func_t,
+        memory_visible_func_t, gpointer);
+void memory_client_free(memory_client_t *);
+void memory_charge(memory_client_t *, gssize);
+void memory_touch(memory_client_t *);
+void memory_set_limit(gsize);
+gsize memory_get_limit(void);
+void memory_set_idle_timeout(guint);
+guint memory_get_idle_timeout(void);
+void memory_collect(void);
+gint luaH_memory_push_stats(lua_State *);
+
+#endif
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
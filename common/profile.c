@@ -0,0 +1,217 @@
+/*
+ * profile.c - Lua/C bridge profiler
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "common/profile.h"
+
+#include <glib.h>
+#include <glib/gprintf.h>
+#include <lauxlib.h>
+
+/** Statistics for one profiled signal, handler or property. */
+typedef struct {
+    /** The kind of crossing. */
+    profile_kind_t kind;
+    /** Interned name of the signal, handler or property. */
+    const gchar *name;
+    /** Interned extra information (the signal a handler is connected to). */
+    const gchar *detail;
+    /** Number of recorded calls. */
+    guint64 calls;
+    /** Accumulated time in microseconds. */
+    gint64 total;
+    /** Longest single call in microseconds. */
+    gint64 max;
+} profile_entry_t;
+
+/* Entries of each kind keyed by their interned name. */
+static GHashTable *profile_entries[PROFILE_LAST];
+
+static const gchar *profile_kind_names[PROFILE_LAST] = {
+    [PROFILE_SIGNAL]   = "signal",
+    [PROFILE_HANDLER]  = "handler",
+    [PROFILE_INDEX]    = "index",
+    [PROFILE_NEWINDEX] = "newindex",
+};
+
+/** Returns an interned "source:line" description of a Lua function.
+ *
+ * \param L The Lua VM state.
+ * \param idx The index of the function on the stack.
+ * \return The description, which is never freed.
+ */
+const gchar *
+profile_handler_name(lua_State *L, gint idx)
+{
+    lua_Debug ar;
+    gchar buf[256];
+    lua_pushvalue(L, idx);
+    if (!lua_getinfo(L, ">S", &ar))
+        return "?";
+    g_snprintf(buf, sizeof(buf), "%s:%d", ar.short_src, ar.linedefined);
+    return g_intern_string(buf);
+}
+
+/** Adds the time elapsed since \c start to an entry.
+ *
+ * \param kind The kind of the crossing.
+ * \param name The name of the signal, handler or property.
+ * \param detail Optional extra information to show in the report.
+ * \param start The value returned by \ref PROFILE_START.
+ */
+void
+profile_record(profile_kind_t kind, const gchar *name, const gchar *detail,
+        gint64 start)
+{
+    gint64 elapsed = l_monotonic_time() - start;
+    profile_entry_t *e;
+
+    if (!profile_entries[kind])
+        profile_entries[kind] = g_hash_table_new_full(g_direct_hash,
+                g_direct_equal, NULL, g_free);
+
+    name = g_intern_string(name);
+    if (!(e = g_hash_table_lookup(profile_entries[kind], name))) {
+        e = g_new0(profile_entry_t, 1);
+        e->kind = kind;
+        e->name = name;
+        e->detail = detail ? g_intern_string(detail) : NULL;
+        g_hash_table_insert(profile_entries[kind], (gpointer) name, e);
+    }
+
+    e->calls++;
+    e->total += elapsed;
+    if (elapsed > e->max)
+        e->max = elapsed;
+}
+
+/** Records a property access as "owner.property".
+ *
+ * \param kind Either \ref PROFILE_INDEX or \ref PROFILE_NEWINDEX.
+ * \param owner The widget type or table name the property belongs to.
+ * \param prop The property name.
+ * \param start The value returned by \ref PROFILE_START.
+ */
+void
+profile_record_property(profile_kind_t kind, const gchar *owner,
+        const gchar *prop, gint64 start)
+{
+    gchar buf[128];
+    g_snprintf(buf, sizeof(buf), "%s.%s", NONULL(owner), NONULL(prop));
+    profile_record(kind, buf, NULL, start);
+}
+
+/** Throws away all collected statistics. */
+void
+profile_reset(void)
+{
+    for (gint i = 0; i < PROFILE_LAST; i++)
+        if (profile_entries[i])
+            g_hash_table_remove_all(profile_entries[i]);
+}
+
+/* sort entries by total time, most expensive first */
+static gint
+profile_entry_cmp(gconstpointer a, gconstpointer b)
+{
+    const profile_entry_t *x = *(profile_entry_t**) a;
+    const profile_entry_t *y = *(profile_entry_t**) b;
+    return (x->total < y->total) - (x->total > y->total);
+}
+
+/* returns a new array of all entries sorted by total time */
+static GPtrArray *
+profile_sorted_entries(void)
+{
+    GPtrArray *entries = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer e;
+
+    for (gint i = 0; i < PROFILE_LAST; i++) {
+        if (!profile_entries[i])
+            continue;
+        g_hash_table_iter_init(&iter, profile_entries[i]);
+        while (g_hash_table_iter_next(&iter, NULL, &e))
+            g_ptr_array_add(entries, e);
+    }
+
+    g_ptr_array_sort(entries, profile_entry_cmp);
+    return entries;
+}
+
+/** Writes a report of all entries sorted by total time to a stream.
+ *
+ * \param f The stream to write to.
+ */
+void
+profile_dump(FILE *f)
+{
+    GPtrArray *entries = profile_sorted_entries();
+
+    g_fprintf(f, "%-8s %10s %12s %10s %10s  %s\n", "kind", "calls",
+            "total (ms)", "avg (us)", "max (us)", "name");
+
+    for (guint i = 0; i < entries->len; i++) {
+        profile_entry_t *e = entries->pdata[i];
+        g_fprintf(f, "%-8s %10" G_GUINT64_FORMAT " %12.3f %10.1f %10"
+                G_GINT64_FORMAT "  %s%s%s\n",
+                profile_kind_names[e->kind], e->calls, e->total / 1e3,
+                (gdouble) e->total / e->calls, e->max, e->name,
+                e->detail ? " <- " : "", NONULL(e->detail));
+    }
+
+    g_ptr_array_free(entries, TRUE);
+}
+
+/** Pushes an array of all entries sorted by total time.
+ *
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack (1).
+ */
+gint
+luaH_profile_report_push(lua_State *L)
+{
+    GPtrArray *entries = profile_sorted_entries();
+
+    lua_createtable(L, entries->len, 0);
+    for (guint i = 0; i < entries->len; i++) {
+        profile_entry_t *e = entries->pdata[i];
+        lua_createtable(L, 0, 6);
+        lua_pushstring(L, profile_kind_names[e->kind]);
+        lua_setfield(L, -2, "kind");
+        lua_pushstring(L, e->name);
+        lua_setfield(L, -2, "name");
+        if (e->detail) {
+            lua_pushstring(L, e->detail);
+            lua_setfield(L, -2, "signal");
+        }
+        lua_pushnumber(L, e->calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, e->total / 1e6);
+        lua_setfield(L, -2, "total");
+        lua_pushnumber(L, e->max / 1e6);
+        lua_setfield(L, -2, "max");
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    g_ptr_array_free(entries, TRUE);
+    return 1;
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
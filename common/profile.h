@@ -0,0 +1,57 @@
+/*
+ * profile.h - Lua/C bridge profiler
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LUAPDF_COMMON_PROFILE_H
+#define LUAPDF_COMMON_PROFILE_H
+
+#include <stdio.h>
+#include <lua.h>
+
+#include "common/util.h"
+#include "globalconf.h"
+
+/** The kinds of Lua/C bridge crossings the profiler keeps statistics on. */
+typedef enum {
+    /** A signal emission, including all of its handlers. */
+    PROFILE_SIGNAL,
+    /** A single Lua signal handler function. */
+    PROFILE_HANDLER,
+    /** A property read through an __index metamethod. */
+    PROFILE_INDEX,
+    /** A property write through a __newindex metamethod. */
+    PROFILE_NEWINDEX,
+    PROFILE_LAST,
+} profile_kind_t;
+
+/** Start timing a profiled section.
+ * \return The current monotonic time or \c 0 if the profiler is disabled. */
+#define PROFILE_START() (globalconf.profile ? l_monotonic_time() : 0)
+
+const gchar *profile_handler_name(lua_State *, gint);
+void profile_record(profile_kind_t, const gchar *, const gchar *, gint64);
+void profile_record_property(profile_kind_t, const gchar *, const gchar *,
+        gint64);
+void profile_reset(void);
+void profile_dump(FILE *);
+gint luaH_profile_report_push(lua_State *);
+
+#endif
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -23,58 +23,73 @@
 #define LUAPDF_COMMON_SIGNAL
 
 #include <glib/garray.h>
-#include <glib/gstrfuncs.h>
+#include <glib/ghash.h>
+#include <glib/gquark.h>
 #include <glib/gtestutils.h>
-#include <glib/gtree.h>
 
 #include "common/util.h"
 
-typedef GTree      signal_t;
+/* Signal names are interned as quarks, so the handler arrays can be kept in
+ * a hash table keyed by the quark and a lookup never compares strings. */
+typedef GHashTable signal_t;
 typedef GPtrArray  signal_array_t;
 
-/* signals tree key compare function */
-static inline gint
-signal_cmp(gconstpointer a, gconstpointer b, gpointer UNUSED(p))
-{
-    return g_strcmp0(a, b);
-}
-
-/* signals tree data destroy function */
+/* signals table data destroy function */
 static inline void
 signal_array_destroy(gpointer *sigfuncs)
 {
     g_ptr_array_free((GPtrArray*) sigfuncs, TRUE);
 }
 
-/* create binary search tree for fast signal array lookups */
+/* create hash table for fast signal array lookups */
 static inline signal_t*
 signal_new(void)
 {
-    return (signal_t*) g_tree_new_full((GCompareDataFunc) signal_cmp,
-        NULL, (GDestroyNotify) g_free, (GDestroyNotify) signal_array_destroy);
+    return (signal_t*) g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify) signal_array_destroy);
 }
 
-/* destory signals tree */
+/* destory signals table */
 static inline void
 signal_destroy(signal_t *signals)
 {
-    g_tree_destroy((GTree*) signals);
+    g_hash_table_destroy((GHashTable*) signals);
+}
+
+/* true if there is no handler for any signal */
+static inline gboolean
+signal_is_empty(signal_t *signals)
+{
+    return !g_hash_table_size((GHashTable*) signals);
+}
+
+static inline signal_array_t*
+signal_lookup_quark(signal_t *signals, GQuark q)
+{
+    return (signal_array_t*) g_hash_table_lookup((GHashTable*) signals,
+        GUINT_TO_POINTER(q));
 }
 
 static inline signal_array_t*
 signal_lookup(signal_t *signals, const gchar *name)
 {
-    return (signal_array_t*) g_tree_lookup((GTree*) signals, (gpointer) name);
+    if (signal_is_empty(signals))
+        return NULL;
+    /* a name which was never interned can not have any handlers */
+    GQuark q = g_quark_try_string(name);
+    return q ? signal_lookup_quark(signals, q) : NULL;
 }
 
 /* add a signal inside a signal array */
 static inline void
 signal_add(signal_t *signals, const gchar *name, gpointer func)
 {
-    signal_array_t *sigfuncs = signal_lookup(signals, name);
+    GQuark q = g_quark_from_string(name);
+    signal_array_t *sigfuncs = signal_lookup_quark(signals, q);
     if (!sigfuncs) {
         sigfuncs = (signal_array_t*) g_ptr_array_new();
-        g_tree_insert((GTree*) signals, (gpointer) g_strdup(name), sigfuncs);
+        g_hash_table_insert((GHashTable*) signals, GUINT_TO_POINTER(q),
+            sigfuncs);
     }
     g_ptr_array_add((GPtrArray*) sigfuncs, func);
 }
@@ -83,12 +98,13 @@ signal_add(signal_t *signals, const gchar *name, gpointer func)
 static inline void
 signal_remove(signal_t *signals, const gchar *name, gpointer func)
 {
-    signal_array_t *sigfuncs = signal_lookup(signals, name);
+    GQuark q = g_quark_try_string(name);
+    signal_array_t *sigfuncs = q ? signal_lookup_quark(signals, q) : NULL;
     if (sigfuncs) {
         g_ptr_array_remove((GPtrArray*) sigfuncs, func);
-        /* prune empty sigfuncs array from the tree */
+        /* prune empty sigfuncs array from the table */
         if (!sigfuncs->len)
-            g_tree_remove((GTree*) signals, (gpointer) name);
+            g_hash_table_remove((GHashTable*) signals, GUINT_TO_POINTER(q));
     }
 }
 
@@ -0,0 +1,216 @@
+/*
+ * trace.c - startup tracing
+ *
+ * Copyright © 2011 Mason Larobina <mason.larobina@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Records the phases of the startup (and every module loaded by require)
+ * until the first document is painted and writes them as Chrome trace event
+ * JSON, which can be viewed in chrome://tracing. */
+
+#include "common/trace.h"
+#include "common/util.h"
+#include "globalconf.h"
+
+#include <glib/gprintf.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/** A single trace event. */
+typedef struct {
+    /** Interned event name. */
+    const gchar *name;
+    /** Interned event category. */
+    const gchar *cat;
+    /** The Chrome trace event phase: 'B'egin, 'E'nd or 'i'nstant. */
+    gchar ph;
+    /** Microseconds since tracing started. */
+    gint64 ts;
+} trace_event_t;
+
+static gboolean tracing;
+static gchar *trace_file;
+static gint64 trace_start;
+static GArray *trace_events;
+/* Names of the events that have begun but not ended yet */
+static GPtrArray *trace_stack;
+
+static void
+trace_add(const gchar *name, const gchar *cat, gchar ph)
+{
+    trace_event_t e = {
+        .name = g_intern_string(name),
+        .cat = g_intern_string(cat),
+        .ph = ph,
+        .ts = l_monotonic_time() - trace_start,
+    };
+    g_array_append_val(trace_events, e);
+}
+
+/** Starts recording trace events.
+ *
+ * \param file The file to write the trace to on \ref trace_finish or NULL
+ * for $XDG_CACHE_HOME/luapdf/startup-trace.json.
+ */
+void
+trace_init(const gchar *file)
+{
+    tracing = TRUE;
+    trace_file = file && *file ? g_strdup(file) : NULL;
+    trace_start = l_monotonic_time();
+    trace_events = g_array_new(FALSE, FALSE, sizeof(trace_event_t));
+    trace_stack = g_ptr_array_new();
+    trace_mark("trace_init");
+}
+
+/** \return Whether trace events are recorded. */
+gboolean
+trace_enabled(void)
+{
+    return tracing;
+}
+
+/** Begins a (possibly nested) trace event.
+ *
+ * \param name The name of the event.
+ * \param cat The category of the event.
+ */
+void
+trace_begin(const gchar *name, const gchar *cat)
+{
+    if (!tracing)
+        return;
+    trace_add(name, cat ? cat : "luapdf", 'B');
+    g_ptr_array_add(trace_stack, g_array_index(trace_events, trace_event_t,
+                trace_events->len - 1).name);
+}
+
+/** Ends the innermost trace event. */
+void
+trace_end(void)
+{
+    if (!tracing || !trace_stack->len)
+        return;
+    trace_add(g_ptr_array_remove_index(trace_stack, trace_stack->len - 1),
+            "luapdf", 'E');
+}
+
+/** Records an instant event.
+ *
+ * \param name The name of the event.
+ */
+void
+trace_mark(const gchar *name)
+{
+    if (tracing)
+        trace_add(name, "luapdf", 'i');
+}
+
+/* write a JSON string literal */
+static void
+trace_write_string(FILE *f, const gchar *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            g_fprintf(f, "\\%c", *s);
+        else if ((guchar) *s < 0x20)
+            g_fprintf(f, "\\u%04x", (guchar) *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/** Ends all open events, writes the trace file and stops tracing. Does
+ * nothing if tracing is disabled or the trace was already written. */
+void
+trace_finish(void)
+{
+    gchar *path;
+    FILE *f;
+
+    if (!tracing)
+        return;
+
+    while (trace_stack->len)
+        trace_end();
+
+    path = trace_file ? g_strdup(trace_file)
+        : g_build_filename(globalconf.cache_dir, "startup-trace.json", NULL);
+
+    if ((f = fopen(path, "w"))) {
+        g_fprintf(f, "{\"traceEvents\":[\n");
+        for (guint i = 0; i < trace_events->len; i++) {
+            trace_event_t *e = &g_array_index(trace_events, trace_event_t, i);
+            g_fprintf(f, "{\"name\":");
+            trace_write_string(f, e->name);
+            g_fprintf(f, ",\"cat\":");
+            trace_write_string(f, e->cat);
+            g_fprintf(f, ",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+                    ",\"pid\":%d,\"tid\":1%s}%s\n", e->ph, e->ts, getpid(),
+                    e->ph == 'i' ? ",\"s\":\"g\"" : "",
+                    i + 1 < trace_events->len ? "," : "");
+        }
+        g_fprintf(f, "]}\n");
+        fclose(f);
+        g_fprintf(stderr, "Wrote startup trace to %s\n", path);
+    } else
+        warn("unable to write startup trace to %s", path);
+
+    tracing = FALSE;
+    g_free(path);
+    g_free(trace_file);
+    g_array_free(trace_events, TRUE);
+    g_ptr_array_free(trace_stack, TRUE);
+}
+
+/* Calls the original require function (the upvalue) inside a trace event
+ * named after the module. */
+static gint
+luaH_trace_require(lua_State *L)
+{
+    gint top = lua_gettop(L), ret;
+
+    trace_begin(luaL_checkstring(L, 1), "require");
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    ret = lua_pcall(L, top, LUA_MULTRET, 0);
+    trace_end();
+
+    if (ret)
+        return lua_error(L);
+    return lua_gettop(L);
+}
+
+/** Wraps the global \c require function to record a trace event for every
+ * loaded module if tracing is enabled.
+ *
+ * \param L The Lua VM state.
+ */
+void
+luaH_trace_setup(lua_State *L)
+{
+    if (!tracing)
+        return;
+    lua_getglobal(L, "require");
+    lua_pushcclosure(L, luaH_trace_require, 1);
+    lua_setglobal(L, "require");
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
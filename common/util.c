@@ -26,6 +26,7 @@
 #include <glib/gprintf.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <time.h>
 
 /* Print error and exit with EXIT_FAILURE code. */
 void
@@ -68,3 +69,13 @@ file_exists(const gchar *filename)
 {
     return (access(filename, F_OK) == 0);
 }
+
+/* Microseconds from an arbitrary point in the past which is not affected by
+ * changes to the system clock. */
+gint64
+l_monotonic_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((gint64) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
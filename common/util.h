@@ -65,6 +65,7 @@ static inline ssize_t l_strlen(const gchar *s) {
 #define p_clear(p, count)       ((void)memset((p), 0, sizeof(*(p)) * (count)))
 
 gboolean file_exists(const gchar*);
+gint64 l_monotonic_time(void);
 void l_exec(const gchar*);
 
 #endif
@@ -48,14 +48,6 @@ endif
 # Packages required to build luapdf
 PKGS := gtk+-2.0 gthread-2.0 poppler-glib cairo-gobject $(LUA_PKG_NAME)
 
-# Build luapdf with libunqiue bindings (for writing simple single-
-# instance applications using dbus).
-# To disable use `make USE_UNIQUE=0`.
-ifneq ($(USE_UNIQUE),0)
-CPPFLAGS += -DWITH_UNIQUE
-PKGS     += unique-1.0
-endif
-
 # Should we load relative config paths first?
 ifneq ($(DEVELOPMENT_PATHS),0)
 CPPFLAGS += -DDEVELOPMENT_PATHS
@@ -67,8 +59,11 @@ $(error Cannot find required libraries to build luapdf. Please check you \
 have the above packages installed and try again.)
 endif
 
+# Lua VM the bytecode cache belongs to (see common/bytecode.c)
+LUA_VM_VERSION := $(LUA_PKG_NAME)-$(shell pkg-config --modversion $(LUA_PKG_NAME))
+
 # Add pre-processor flags
-CPPFLAGS := -DVERSION=\"$(VERSION)\" $(CPPFLAGS)
+CPPFLAGS := -DVERSION=\"$(VERSION)\" -DLUA_VM_VERSION=\"$(LUA_VM_VERSION)\" $(CPPFLAGS)
 
 # Generate compiler options
 INCS     := $(shell pkg-config --cflags $(PKGS)) -I./
@@ -76,7 +71,7 @@ CFLAGS   := -std=gnu99 -ggdb -W -Wall -Wextra $(INCS) $(CFLAGS)
 
 # Generate linker options
 LIBS     := $(shell pkg-config --libs $(PKGS))
-LDFLAGS  := $(LIBS) $(LDFLAGS) -Wl,--export-dynamic
+LDFLAGS  := $(LIBS) $(LDFLAGS) -lm -Wl,--export-dynamic
 
 # Building on OSX
 # TODO: These lines have never been tested
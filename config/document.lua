@@ -29,13 +29,20 @@ document.init_funcs = {
 
     -- Update scroll widget
     scroll_update = function (doc, w)
-        doc:add_signal("expose", function (doc)
+        doc:add_signal("scroll-changed", function (doc, x, y, page, npages)
             if w:is_current(doc) then
-                w:update_scroll(doc)
+                w:update_scroll(doc, y, page, npages)
             end
         end)
     end,
 
+    -- Scroll smoothly with the mouse wheel, the button binds are used for
+    -- modified wheel events or when smooth scrolling is disabled
+    smooth_scroll = function (doc, w)
+        doc.smooth_scroll = globals.smooth_scroll ~= false
+        doc.scroll_step = globals.scroll_step or 40
+    end,
+
     -- Catch keys in non-passthrough modes
     mode_key_filter = function (doc, w)
         doc:add_signal("key-press", function ()
@@ -110,21 +117,7 @@ document.methods = {
     end,
 
     get_current_page = function (doc, w)
-        local s = doc.scroll
-        local mid = {
-            x = s.x + (s.xpage_size / 2),
-            y = s.y + (s.ypage_size / 2),
-        }
-        for idx, page in ipairs(doc.pages) do
-            local l = page.x
-            local r = page.x + page.width
-            local t = page.y
-            local b = page.y + page.height
-            if l <= mid.x and r >= mid.x and t <= mid.y and b >= mid.y then
-                return idx
-            end
-        end
-        return 1
+        return doc.current_page
     end,
 
     scroll_to_dest = function (doc, w, dest)
@@ -1,6 +1,7 @@
 -- Global variables for luapdf
 globals = {
     scroll_step         = 40,
+    smooth_scroll       = true,
     zoom_step           = 0.1,
     max_cmd_history     = 100,
     max_srch_history    = 100,
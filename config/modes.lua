@@ -71,6 +71,9 @@ window.init_funcs.modes_setup = function (w)
             -- Check if last history item is identical
             if hist and hist.items and hist.items[hist.len or -1] ~= text then
                 table.insert(hist.items, text)
+                -- Keep the prefix index of the history items up to date
+                local index = hist.index
+                if index then index:insert(text, (index:get(text) or 0) + 1) end
             end
         end
     end)
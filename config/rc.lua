@@ -2,24 +2,31 @@
 -- luapdf configuration file, more information at http://luapdf.org/ --
 -----------------------------------------------------------------------
 
-if unique then
-    unique.new("org.luapdf")
-    -- Check for a running luapdf instance
-    if unique.is_running() then
-        if uris[1] then
-            for _, uri in ipairs(uris) do
-                unique.send_message("tabopen " .. uri)
-            end
-        else
-            unique.send_message("winopen")
+-- Hand the documents to a running luapdf instance
+if ipc and ipc.is_running() then
+    local reqs = {}
+    for _, uri in ipairs(uris) do
+        if not string.match(uri, "^/") then
+            uri = require("lfs").currentdir() .. "/" .. uri
         end
-        luapdf.quit()
+        table.insert(reqs, "tabopen " .. uri)
     end
+    local replies, err = ipc.send(reqs[1] and reqs or { "winopen" })
+    for _, reply in ipairs(replies or { "-" .. tostring(err) }) do
+        if string.sub(reply, 1, 1) ~= "+" then
+            io.stderr:write(string.sub(reply, 2) .. "\n")
+        end
+    end
+    luapdf.quit()
 end
 
 -- Load library of useful functions for luapdf
 require "lousy"
 
+-- Pass event modifiers as integer masks, which lousy.bind matches without
+-- building any tables
+luapdf.modifier_mask = true
+
 -- Small util functions to print output (info prints only when luapdf.verbose is true)
 function warn(...) io.stderr:write(string.format(...) .. "\n") end
 function info(...) if luapdf.verbose then io.stderr:write(string.format(...) .. "\n") end end
@@ -56,17 +63,30 @@ require "binds"
 -- Add document index support
 require "index"
 
+-- Load modules on the first use of their commands and binds
+require "lazy"
+
 -- Add quickmarks support & manager
-require "quickmarks"
+lazy.require("quickmarks", {
+    cmds = { "qmark", "qma", "qmarkedit", "qme", "delqmarks", "delqm",
+        "qmarks", "delqmarks!", "delqm!" },
+    bufs = { normal = { "^g[onw]%w$", "^M%w$" } },
+})
 
 -- Add command to list closed tabs & bind to open closed tabs
-require "undoclose"
+lazy.require("undoclose", {
+    cmds = { "undolist" },
+    keys = { normal = { {{}, "u"} } },
+})
 
 -- Add command to list tab history items
 require "tabhistory"
 
 -- Add bookmarks support
-require "bookmarks"
+lazy.require("bookmarks", {
+    cmds = { "bookmark", "bm", "bookdel", "bookexport" },
+    keys = { normal = { {{}, "B"} } },
+})
 
 -- Add command history
 require "cmdhist"
@@ -87,31 +107,25 @@ require "dump"
 -- End user script loading --
 -----------------------------
 
--- Restore last saved session
-local w = (session and session.restore())
+-- Restore last saved session (a daemon waits for ipc requests instead)
+local w = (not luapdf.daemon) and session and session.restore()
 if w then
     for i, uri in ipairs(uris) do
         w:new_tab(uri, {switch = (i == 1)})
     end
-else
+elseif uris[1] or not luapdf.daemon then
     -- Or open new window
     window.new(uris)
 end
 
--------------------------------------------
--- Open URIs from other luapdf instances --
--------------------------------------------
-
-if unique then
-    unique.add_signal("message", function (msg, screen)
-        local cmd, arg = string.match(msg, "^(%S+)%s*(.*)")
-        local w = lousy.util.table.values(window.bywidget)[1]
-        if cmd == "tabopen" then
-            w:new_tab(arg)
-        elseif cmd == "winopen" then
-            w = window.new((arg ~= "") and { arg } or {})
-        end
-        w.win:set_screen(screen)
+--------------------------------------------
+-- Answer requests of luapdfc and friends --
+--------------------------------------------
+
+if ipc and ipc.listen() then
+    require "remote"
+    ipc.add_signal("message", function (msg, trusted)
+        return remote.handle(msg, trusted)
     end)
 end
 
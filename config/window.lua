@@ -131,6 +131,7 @@ window.init_funcs = {
             w:update_tab_count(idx)
             w:update_win_title(doc)
             w:update_path(doc)
+            w:update_scroll(doc)
             w:update_tablist(idx)
             w:update_buf()
         end)
@@ -143,7 +144,7 @@ window.init_funcs = {
     last_win_check = function (w)
         w.win:add_signal("destroy", function ()
             -- call the quit function if this was the last window left
-            if #luapdf.windows == 0 then luapdf.quit() end
+            if #luapdf.windows == 0 and not luapdf.daemon then luapdf.quit() end
             if w.close_win then w:close_win() end
         end)
     end,
@@ -449,29 +450,27 @@ window.methods = {
         end
     end,
 
-    update_scroll = function (w, doc)
+    -- Show the vertical scroll position and the current page. The values are
+    -- those of the document's scroll-changed signal, they are read from the
+    -- document when not given.
+    update_scroll = function (w, doc, y, page, npages)
         if not doc then doc = w:get_current() end
         local label = w.sbar.r.scroll
         if doc then
-            local text = string.format("%s/%s", doc.current, #doc.pages)
-            if label.text ~= text then label.text = text end
-            label:show()
-        else
-            label:hide()
-        end
-    end,
-
-    update_scroll = function (w, view)
-        if not view then view = w:get_current() end
-        local label = w.sbar.r.scroll
-        if view then
-            local scroll = view.scroll
-            local y, max, text = scroll.y, scroll.ymax
-            if     max == 0   then text = "All"
-            elseif y   == 0   then text = "Top"
-            elseif y   == max then text = "Bot"
-            else text = string.format("%2d%% (%s/%s)", (y/max) * 100, doc.current, #doc.pages)
+            if not page then
+                local scroll = doc.scroll
+                if scroll.ymax > 0 then
+                    y = math.floor(scroll.y / scroll.ymax * 100)
+                end
+                page, npages = doc.current_page, #doc.pages
+            end
+            local text
+            if     not y    then text = "All"
+            elseif y == 0   then text = "Top"
+            elseif y == 100 then text = "Bot"
+            else text = string.format("%2d%%", y)
             end
+            text = string.format("%s (%d/%d)", text, page, npages)
             if label.text ~= text then label.text = text end
             label:show()
         else
@@ -593,8 +592,8 @@ window.methods = {
         -- Remove all window table vars
         for k, _ in pairs(w) do w[k] = nil end
 
-        -- Quit if closed last window
-        if #luapdf.windows == 0 then luapdf.quit() end
+        -- Quit if closed last window (unless serving ipc requests)
+        if #luapdf.windows == 0 and not luapdf.daemon then luapdf.quit() end
     end,
 
     -- Navigate current doc or open new tab
@@ -616,7 +615,7 @@ window.methods = {
         -- Generate luapdf launch command.
         local args = {({string.gsub(luapdf.execpath, " ", "\\ ")})[1]}
         if luapdf.verbose then table.insert(args, "-v") end
-        -- Relaunch without libunique bindings?
+        -- Relaunch without the ipc lib?
         if luapdf.nounique then table.insert(args, "-U") end
 
         -- Get new config path
@@ -666,7 +665,10 @@ window.indexes = {
 
 -- Create new window
 function window.new(paths)
+    luapdf.trace_begin("window.new")
+    luapdf.trace_begin("window.build")
     local w = window.build()
+    luapdf.trace_end()
 
     -- Set window metatable
     setmetatable(w, {
@@ -691,15 +693,18 @@ function window.new(paths)
     end
 
     -- Populate notebook with tabs
+    luapdf.trace_begin("window.new_tabs")
     for _, path in ipairs(paths or {}) do
         w:new_tab(path, {switch = false})
     end
+    luapdf.trace_end()
 
     -- Set initial mode
     w:set_mode()
 
     -- Show window
     w.win:show()
+    luapdf.trace_end()
 
     return w
 end
@@ -7,8 +7,6 @@
 -- Grab environment we need
 local table = table
 local string = string
-local io = io
-local os = os
 local unpack = unpack
 local type = type
 local pairs = pairs
@@ -20,9 +18,9 @@ local util = lousy.util
 local add_binds, add_cmds = add_binds, add_cmds
 local tonumber = tonumber
 local tostring = tostring
-local window = window
+local math = math
 
--- Bookmark functions that operate on a flatfile and output to html
+-- Bookmark functions that operate on an append-only log and output to html
 module("bookmarks")
 
 -- Loaded bookmarks
@@ -30,10 +28,11 @@ local data = {}
 
 -- Some default settings
 bookmarks_file = capi.luapdf.data_dir .. '/bookmarks'
+html_file = capi.luapdf.data_dir .. '/bookmarks.html'
 
 -- Templates
 block_template = [==[<div class="tag"><h1>{tag}</h1><ul>{links}</ul></div>]==]
-link_template  = [==[<li><a href="{uri}">{name}</a> <span class="id">{id}</span></li>]==]
+link_template  = [==[<li><a href="file://{path}">{name}</a> <span class="id">{id}</span></li>]==]
 
 html_template = [==[
 <html>
@@ -95,104 +94,407 @@ html_style = [===[
     }
 ]===]
 
+-- Number of records in the bookmarks log
+local records = 0
+
+-- Whether the last record of the log lacks its newline (older versions
+-- wrote the file without a final newline)
+local unterminated = false
+
+-- Number of bookmarks
+local nbookmarks = 0
+
+-- Sorted arrays of bookmark paths by tag
+local bytag = {}
+
+-- Sorted arrays of all bookmark paths and of all tags
+local sorted, tagnames = {}, {}
+
+-- Whether a log is being replayed, the arrays are then rebuilt afterwards
+local replaying = false
+
+-- Whether the bookmarks file has been read or is being read
+local loaded, loading = false, false
+
+-- Functions waiting for the bookmarks file to be read
+local waiting = {}
+
+-- Incremented by `clear()` to drop the results of earlier reads
+local generation = 0
+
+-- Whether a compaction of the log is scheduled
+local compacting = false
+
+--- Compact the log once it holds this many records more than twice the
+-- number of bookmarks.
+compact_slack = 64
+
+-- Find the position of a value in a sorted array, or where it belongs
+local function search(array, value)
+    local lo, hi = 1, #array + 1
+    while lo < hi do
+        local mid = math.floor((lo + hi) / 2)
+        if array[mid] < value then lo = mid + 1 else hi = mid end
+    end
+    return lo, array[lo] == value
+end
+
+-- Insert a value into a sorted array unless it is there already. Returns
+-- whether it was inserted.
+local function insert(array, value)
+    local i, found = search(array, value)
+    if not found then table.insert(array, i, value) end
+    return not found
+end
+
+-- Remove a value from a sorted array. Returns whether it was there.
+local function remove(array, value)
+    local i, found = search(array, value)
+    if found then table.remove(array, i) end
+    return found
+end
+
+-- Add or remove a bookmark from the tag index
+local function index_tags(bm, add)
+    if replaying then return end
+    for _, tag in ipairs(bm.tags) do
+        local paths = bytag[tag]
+        if add then
+            if not paths then
+                paths = {}
+                bytag[tag] = paths
+                insert(tagnames, tag)
+            end
+            insert(paths, bm.path)
+        elseif paths and remove(paths, bm.path) and not paths[1] then
+            bytag[tag] = nil
+            remove(tagnames, tag)
+        end
+    end
+end
+
+-- Rebuild the sorted arrays after replaying a log
+local function reindex()
+    sorted, bytag, tagnames = {}, {}, {}
+    for path, bm in pairs(data) do
+        table.insert(sorted, path)
+        for _, tag in ipairs(bm.tags) do
+            local paths = bytag[tag]
+            if not paths then
+                paths = {}
+                bytag[tag] = paths
+                table.insert(tagnames, tag)
+            end
+            -- Skip tags given twice
+            if paths[#paths] ~= path then table.insert(paths, path) end
+        end
+    end
+    table.sort(sorted)
+    table.sort(tagnames)
+    for _, paths in pairs(bytag) do table.sort(paths) end
+end
+
+-- Set the tags of a bookmark, creating or (if tags is nil) removing it
+local function set(path, tags)
+    local bm = data[path]
+    if bm then index_tags(bm, false) end
+    if tags then
+        if not bm then
+            nbookmarks = nbookmarks + 1
+            if not replaying then insert(sorted, path) end
+        end
+        bm = { path = path, tags = tags }
+        data[path] = bm
+        index_tags(bm, true)
+    elseif bm then
+        nbookmarks = nbookmarks - 1
+        if not replaying then remove(sorted, path) end
+        data[path] = nil
+    end
+end
+
+-- Parse a line of the bookmarks file. Lines are either "+\tpath\ttags",
+-- "-\tpath" or (written by older versions) "path\ttags".
+local function parse(line)
+    local op, path, tags = string.match(line, "^([+-])\t([^\t]*)\t?(.*)$")
+    if not op then
+        op, path, tags = "+", string.match(line, "^([^\t]*)\t?(.*)$")
+    end
+    if path and path ~= "" then
+        return op, path, (tags and tags ~= "") and util.string.split(tags) or {}
+    end
+end
+
+-- Make sure the bookmarks file is read (or being read). Until the read has
+-- finished the in-memory bookmarks only hold the changes made so far.
+local function ensure_loaded()
+    if not loaded and not loading then load() end
+end
+
+-- Call a function once the bookmarks file has been read
+local function when_loaded(fn)
+    ensure_loaded()
+    if loaded then fn() else table.insert(waiting, fn) end
+end
+
+-- Mark the bookmarks as loaded and run the functions waiting for them
+local function finish_loading()
+    loaded, loading = true, false
+    local fns = waiting
+    waiting = {}
+    for _, fn in ipairs(fns) do fn() end
+end
+
 --- Clear in-memory bookmarks
 function clear()
-    data = {}
+    data, bytag, sorted, tagnames, nbookmarks = {}, {}, {}, {}, 0
+    generation = generation + 1
+    finish_loading()
 end
 
---- Save the in-memory bookmarks to flatfile.
+--- Save the in-memory bookmarks to flatfile, replacing the log with one
+-- record per bookmark. The file is written in the background.
 -- @param file The destination file or the default location if nil.
 function save(file)
-    if not file then file = bookmarks_file end
+    -- Don't replace the log before all of it was read
+    if not loaded then
+        return when_loaded(function () save(file) end)
+    end
 
     local lines = {}
-    for _, bm in pairs(data) do
-        local subs = { uri = bm.uri, tags = table.concat(bm.tags or {}, " "), }
-        local line = string.gsub("{uri}\t{tags}", "{(%w+)}", subs)
-        table.insert(lines, line)
+    for _, path in ipairs(paths()) do
+        local bm = data[path]
+        table.insert(lines, string.format("+\t%s\t%s", path,
+            table.concat(bm.tags, " ")))
     end
 
-    -- Write table to disk
-    local fh = io.open(file, "w")
-    fh:write(table.concat(lines, "\n"))
-    io.close(fh)
+    -- Replace the file in the background, queued behind earlier appends
+    local dest = file or bookmarks_file
+    capi.luapdf.fs.write_file(dest, table.concat(lines, "\n")
+        .. (#lines > 0 and "\n" or ""))
+
+    if dest == bookmarks_file then records, unterminated = #lines, false end
+end
+
+--- Compact the bookmarks log if it has grown much larger than the number of
+-- bookmarks it holds. The compaction runs when luapdf is idle.
+function compact()
+    if compacting then return end
+    compacting = true
+    capi.luapdf.idle_add(function ()
+        compacting = false
+        save()
+        return false
+    end)
+end
+
+-- Append a record to the bookmarks log
+local function append(path, tags)
+    local line = tags and string.format("+\t%s\t%s\n", path,
+        table.concat(tags, " ")) or string.format("-\t%s\n", path)
+
+    -- Don't continue the last record of the log
+    if unterminated then line, unterminated = "\n" .. line, false end
+    capi.luapdf.fs.append(bookmarks_file, line)
+
+    records = records + 1
+    if records > 2 * count() + compact_slack then compact() end
+end
+
+--- Get a bookmark by its path.
+-- @param path The path of the bookmark.
+-- @return The bookmark table with the `path` and `tags` fields or nil.
+function get(path)
+    ensure_loaded()
+    return data[path]
+end
+
+--- Return the number of bookmarks.
+function count()
+    ensure_loaded()
+    return nbookmarks
+end
+
+--- Return the sorted array of all bookmark paths. The array must not be
+-- modified.
+function paths()
+    ensure_loaded()
+    return sorted
+end
+
+--- Return the sorted array of paths of all bookmarks with the given tag.
+-- The array must not be modified.
+-- @param tag The tag.
+function tagged(tag)
+    ensure_loaded()
+    return bytag[tag] or {}
+end
+
+--- Return the sorted array of all tags. The array must not be modified.
+function tags()
+    ensure_loaded()
+    return tagnames
 end
 
 --- Add a bookmark to the in-memory bookmarks table
-function add(uri, tags, replace, save_bookmarks)
-    assert(uri ~= nil, "bookmark add: no URI given")
+function add(path, tags, replace, save_bookmarks)
+    assert(path ~= nil, "bookmark add: no path given")
+
+    -- Change the bookmarks once all of them are known
+    if not loaded then
+        return when_loaded(function ()
+            add(path, tags, replace, save_bookmarks)
+        end)
+    end
     if not tags then tags = {} end
 
     -- Create tags table from string
     if type(tags) == "string" then tags = util.string.split(tags) end
 
-    if not replace and data[uri] then
-        local bm = data[uri]
+    local bm = data[path]
+    if not replace and bm then
         -- Merge tags
+        local merged = util.table.clone(bm.tags)
         for _, tag in ipairs(tags) do
-            if not util.table.hasitem(bm, tag) then table.insert(bm, tag) end
+            if not util.table.hasitem(merged, tag) then
+                table.insert(merged, tag)
+            end
         end
-    else
-        -- Insert new bookmark
-        data[uri] = { uri = uri, tags = tags }
+        tags = merged
     end
+    set(path, tags)
 
     -- Save by default
-    if save_bookmarks ~= false then save() end
+    if save_bookmarks ~= false then append(path, tags) end
 end
 
 -- Remove a bookmark from the in-memory bookmarks table by index
--- @param index Index of the bookmark to delete
+-- @param index Index of the bookmark to delete (in the order of `paths()`)
+-- or its path
 -- @param save_bookmarks Option whether to save the bookmarks to file or not
 function del(index, save_bookmarks)
-    assert(index ~= nil, "bookdel: Index has to be a number")
-    assert(index > 0, "bookdel: Index has to be > 0")
+    if type(index) ~= "string" then
+        assert(index ~= nil, "bookdel: Index has to be a number")
+        assert(index > 0, "bookdel: Index has to be > 0")
+    end
 
-    -- Remove entry from data table
-    local id = 0
-    for _, bm in pairs(data) do
-        id = id + 1
-        if id == index then
-            data[_] = nil
-            break
-        end
+    -- Indexes refer to all bookmarks, so wait for them
+    if not loaded then
+        return when_loaded(function () del(index, save_bookmarks) end)
     end
 
-    -- Save by default
-    if save_bookmarks ~= false then save() end
+    local path = index
+    if type(index) == "number" then path = paths()[index] end
+    if not path or not get(path) then return end
 
-    -- Refresh open bookmarks views
-    for _, w in pairs(window.bywidget) do
-        for _, v in ipairs(w.tabs.children) do
-            if string.match(v.uri, "^luapdf://bookmarks/?") then
-                v:reload()
-            end
-        end
-    end
+    -- Remove entry from data table
+    set(path, nil)
+
+    -- Save by default
+    if save_bookmarks ~= false then append(path, nil) end
 end
 
---- Load bookmarks from a flatfile to memory.
+--- Load bookmarks from a flatfile to memory. The file is read in the
+-- background, queued before any later appends to the log.
 -- @param file The bookmarks file or the default bookmarks location if nil.
 -- @param clear_first Should the bookmarks in memory be dumped before loading.
-function load(file, clear_first)
+-- @param callback Optional function called once the bookmarks are loaded.
+function load(file, clear_first, callback)
     if clear_first then clear() end
-
-    -- Find a bookmarks file
     if not file then file = bookmarks_file end
-    if not os.exists(file) then return end
 
-    -- Read lines into bookmarks data table
-    for line in io.lines(file or bookmarks_file) do
-        local uri, tags = unpack(util.string.split(line, "\t"))
-        if uri ~= "" then add(uri, tags, false, false) end
+    -- The first read of the log holds back everything that needs all of it
+    local initial = not loaded and not loading
+    if initial then loading = true end
+    local gen = generation
+
+    capi.luapdf.fs.read_file(file, function (contents)
+        -- The bookmarks were cleared while the file was read
+        if gen ~= generation then return end
+
+        -- Replay the records of the log (a missing file has none) and sort
+        -- the bookmarks once afterwards
+        local n = 0
+        replaying = true
+        for line in string.gmatch(contents or "", "[^\n]+") do
+            local op, path, tags = parse(line)
+            if op == "+" then
+                set(path, tags)
+            elseif op == "-" then
+                set(path, nil)
+            end
+            n = n + 1
+        end
+        replaying = false
+        reindex()
+
+        if file == bookmarks_file then
+            records = n
+            unterminated = contents ~= nil and contents ~= ""
+                and string.sub(contents, -1) ~= "\n"
+        end
+        if initial then finish_loading() end
+        if callback then callback() end
+    end)
+end
+
+--- Generate a HTML page of all bookmarks grouped by tag. Yields to the main
+-- loop when called from a task (see `lousy.tasks`).
+-- @return The HTML page.
+function html()
+    local ids = {}
+    for id, path in ipairs(paths()) do ids[path] = id end
+
+    -- Copy the arrays walked across yields, bookmarks may change meanwhile
+    local groups = util.table.clone(tags())
+    local untagged = {}
+    for _, path in ipairs(paths()) do
+        if not data[path].tags[1] then table.insert(untagged, path) end
+    end
+
+    local blocks = {}
+    local function block(tag, paths)
+        local links = {}
+        for _, path in ipairs(paths) do
+            local subs = { uri = util.escape(path), path = util.escape(path),
+                name = util.escape(string.match(path, "[^/]*$")),
+                id = ids[path] }
+            table.insert(links, (string.gsub(link_template, "{(%w+)}", subs)))
+            lousy.tasks.yield()
+        end
+        local subs = { tag = util.escape(tag), links = table.concat(links, "\n") }
+        table.insert(blocks, (string.gsub(block_template, "{(%w+)}", subs)))
     end
+    for _, tag in ipairs(groups) do block(tag, util.table.clone(tagged(tag))) end
+    if untagged[1] then block("untagged", untagged) end
+
+    local subs = { title = html_page_title, style = html_style,
+        tags = table.concat(blocks, "\n") }
+    return (string.gsub(html_template, "{(%w+)}", subs))
+end
+
+--- Write the HTML page of all bookmarks to a file in the background. The
+-- page is generated by a low priority task.
+-- @param file The destination file or `html_file` if nil.
+-- @param callback Optional function called with true or nil and an error
+-- message once the file is written.
+-- @return The destination file.
+function export(file, callback)
+    file = file or html_file
+    when_loaded(function ()
+        lousy.tasks.spawn(html, { name = "bookmarks export",
+            priority = "low", done = function (page)
+                capi.luapdf.fs.write_file(file, page, callback)
+            end })
+    end)
+    return file
 end
 
 -- Add normal binds.
 local key, buf = lousy.bind.key, lousy.bind.buf
 add_binds("normal", {
     key({}, "B", function (w)
-        w:enter_cmd(":bookmark " .. (w:get_current().uri or "http://") .. " ")
+        w:enter_cmd(":bookmark " .. (w:get_current().path or "") .. " ")
     end),
 })
 
@@ -201,19 +503,28 @@ local cmd = lousy.bind.cmd
 add_cmds({
     cmd({"bookmark", "bm"}, function (w, a)
         if not a then
-            w:error("Missing bookmark arguments (use `:bookmark <uri> <tags>`)")
+            w:error("Missing bookmark arguments (use `:bookmark <path> <tags>`)")
             return
         end
         local args = util.string.split(a)
-        local uri = table.remove(args, 1)
-        add(uri, args)
+        local path = table.remove(args, 1)
+        add(path, args)
     end),
 
     cmd("bookdel", function (w, a)
-        del(tonumber(a))
+        del(tonumber(a) or a)
     end),
-})
 
-load()
+    cmd("bookexport", function (w, a)
+        local file
+        file = export(a, function (ok, err)
+            if ok then
+                w:notify("Exported bookmarks to: " .. file)
+            else
+                w:error("Unable to export bookmarks: " .. err)
+            end
+        end)
+    end),
+})
 
 -- vim: et:sw=4:ts=8:sts=4:tw=80
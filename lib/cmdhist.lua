@@ -44,6 +44,13 @@ window.init_funcs.add_hist_binds = function (w)
         if mode and mode.history then
             local h = mode.history
             if not h.items then h.items = {} end
+            -- Index items by prefix (counting duplicates) for completion
+            if not h.index then
+                h.index = lousy.prefix.new()
+                for _, item in ipairs(h.items) do
+                    h.index:insert(item, (h.index:get(item) or 0) + 1)
+                end
+            end
             h.len = #(h.items)
             h.cursor = nil
             h.orig = nil
@@ -54,6 +61,11 @@ window.init_funcs.add_hist_binds = function (w)
             -- Trim history
             if h.maxlen and h.len > (h.maxlen * 1.5) then
                 local items = {}
+                for i = 1, (h.len - h.maxlen) - 1 do
+                    local item, n = h.items[i], h.index:get(h.items[i])
+                    if n > 1 then h.index:insert(item, n - 1)
+                    else h.index:remove(item) end
+                end
                 for i = (h.len - h.maxlen), h.len do
                     table.insert(items, h.items[i])
                 end
@@ -9,7 +9,6 @@ local ipairs = ipairs
 local setmetatable = setmetatable
 local string = string
 local table = table
-local unpack = unpack
 
 -- Get luapdf environment
 local lousy = require "lousy"
@@ -68,12 +67,12 @@ function update_completions(w, text, pos)
     state.right = string.sub(text, pos + 1)
 
     -- Call each completion function
-    local groups = {}
+    local rows = {}
     for _, func in ipairs(_M.order) do
-        table.insert(groups, func(state) or {})
+        for _, row in ipairs(func(state) or {}) do
+            rows[#rows + 1] = row
+        end
     end
-    -- Join all result tables
-    rows = lousy.util.table.join(unpack(groups))
 
     if rows[1] then
         -- Prevent callbacks triggering recursive updates.
@@ -149,26 +148,34 @@ funcs = {
     command = function (state)
         -- We are only interested in the first word
         if string.match(state.left, "%s") then return end
-        -- Check each command binding for matches
-        local pat = "^" .. state.left
-        local cmds = {}
-        for _, b in ipairs(get_mode("command").binds) do
-            if b.cmds then
-                for i, cmd in ipairs(b.cmds) do
-                    if string.match(cmd, pat) then
-                        if i == 1 then
-                            cmd = ":" .. cmd
-                        else
-                            cmd = string.format(":%s (:%s)", cmd, b.cmds[1])
-                        end
-                        cmds[cmd] = { escape(cmd), left = ":" .. b.cmds[1] }
+        -- Look up the command names starting with the typed prefix
+        local binds = get_mode("command").binds
+        local idx = lousy.bind.index(binds)
+        local names, lists = idx.names:match(state.left)
+        local cmds, keys = {}, {}
+        for n, name in ipairs(names) do
+            for _, pos in ipairs(lists[n]) do
+                local b = binds[pos]
+                -- Only show the first matching name of each bind
+                local first
+                for _, c in ipairs(b.cmds) do
+                    if string.sub(c, 1, #state.left) == state.left then
+                        first = c
                         break
                     end
                 end
+                if first == name then
+                    local cmd = ":" .. name
+                    if name ~= b.cmds[1] then
+                        cmd = string.format(":%s (:%s)", name, b.cmds[1])
+                    end
+                    if not cmds[cmd] then
+                        cmds[cmd] = { escape(cmd), left = ":" .. b.cmds[1] }
+                        table.insert(keys, cmd)
+                    end
+                end
             end
         end
-        -- Sort commands
-        local keys = lousy.util.table.keys(cmds)
         -- Return if no results
         if not keys[1] then return end
         -- Build completion menu items
@@ -178,11 +185,29 @@ funcs = {
         end
         return ret
     end,
+
+    -- Add matching command history items to the menu
+    history = function (state)
+        local hist = get_mode("command").history
+        if not hist or not hist.index then return end
+        local items = hist.index:match(":" .. state.left, max_history)
+        -- Return if no results
+        if not items[1] then return end
+        local ret = {{ "History", title = true }}
+        for _, item in ipairs(items) do
+            table.insert(ret, { escape(item), left = item })
+        end
+        return ret
+    end,
 }
 
+-- Maximum number of history items to show
+max_history = 20
+
 -- Order of completion items
 order = {
     funcs.command,
+    funcs.history,
 }
 
 -- vim: et:sw=4:ts=8:sts=4:tw=80
@@ -25,11 +25,14 @@ local dump = function (w, fname, get_text)
     local downdir = string.gsub(fname, "[^/]*$", "")
     local file = a or luapdf.save_file("Save file", w.win, downdir, fname)
     if file then
-        local fd = assert(io.open(file, "w"), "failed to open: " .. file)
-        local text = get_text()
-        assert(fd:write(text), "unable to save text")
-        io.close(fd)
-        w:notify("Dumped text to: " .. file)
+        -- Write in the background, dumps of large documents can be huge
+        capi.luapdf.fs.write_file(file, get_text(), function (ok, err)
+            if ok then
+                w:notify("Dumped text to: " .. file)
+            else
+                w:error("Unable to save text: " .. err)
+            end
+        end)
     end
 end
 
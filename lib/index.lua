@@ -6,26 +6,40 @@
 -- Add index command
 local cmd = lousy.bind.cmd
 add_cmds({
-    cmd("index",                function (w) w:set_mode("index") end),
+    -- Show the index, only showing entries containing the argument if given
+    cmd("index",                function (w, a)
+        w.index_filter = a
+        w:set_mode("index")
+    end),
 })
 
 -- Add mode to display the index in an interactive menu
 new_mode("index", {
     enter = function (w)
         local rows = {{ "Index", title = true }}
-        local build_menu
-        build_menu = function (t, indent)
-            for _, action in pairs(t) do
-                table.insert(rows, { indent .. action.title, dest = action.destination })
-                build_menu(action.children, indent .. "  ")
+        local filter = w.index_filter
+        w.index_filter = nil
+        -- Walk the index one entry at a time
+        local entries = w:get_current().index_iter
+        w.index_task = lousy.tasks.spawn(function ()
+            for title, dest, depth in entries do
+                table.insert(rows, { string.rep("  ", depth) .. title, dest = dest })
+                -- Let large indexes be built between redraws
+                lousy.tasks.yield()
             end
-        end
-        build_menu(w:get_current().index, "  ")
-        w.menu:build(rows)
+        end, { name = "index", done = function ()
+            w.index_task = nil
+            w.menu:build(rows)
+            if filter then w.menu:filter(filter) end
+        end })
         w:notify("Use j/k to move, t tabopen, w winopen.", false)
     end,
 
     leave = function (w)
+        if w.index_task then
+            w.index_task:cancel()
+            w.index_task = nil
+        end
         w.menu:hide()
     end,
 })
@@ -0,0 +1,91 @@
+------------------------------------------------------------
+-- Load modules on the first use of their binds           --
+-- © 2011 Mason Larobina  <mason.larobina@gmail.com>      --
+------------------------------------------------------------
+
+-- Get Lua environment
+local ipairs = ipairs
+local pairs = pairs
+local rrequire = require
+local table = table
+
+-- Get luapdf environment
+local lousy = require "lousy"
+local add_binds = add_binds
+local get_mode = get_mode
+
+module "lazy"
+
+-- Stub binds of the modules not loaded yet, indexed by module name and mode
+local stubs = {}
+
+-- Remove the stub binds of a module from their modes
+local function remove_stubs(name)
+    for mode, list in pairs(stubs[name] or {}) do
+        local binds = (get_mode(mode) or {}).binds or {}
+        for i = #binds, 1, -1 do
+            if list[binds[i]] then table.remove(binds, i) end
+        end
+    end
+    stubs[name] = nil
+end
+
+-- Regenerate the window binds after the module added its binds
+local function update_binds(w)
+    if w.mode and w.mode.name then w:update_binds(w.mode.name) end
+end
+
+--- Load a module now and remove its stub binds.
+-- @param name The module name.
+-- @return The module.
+function load(name)
+    local m = rrequire(name)
+    remove_stubs(name)
+    return m
+end
+
+--- Register a module to be loaded on the first use of one of its commands
+-- or binds. Stub binds are added which load the module and then dispatch the
+-- key, buffer or command again to the binds of the module.
+-- @param name The module name.
+-- @param spec A table of the commands and binds of the module:
+-- `cmds` is an array of command names, `keys` maps mode names to arrays of
+-- `{ mods, key }` tables and `bufs` maps mode names to arrays of buffer
+-- patterns.
+function require(name, spec)
+    local add = function (mode, b)
+        stubs[name] = stubs[name] or {}
+        stubs[name][mode] = stubs[name][mode] or {}
+        stubs[name][mode][b] = true
+        add_binds(mode, { b })
+    end
+
+    if spec.cmds and spec.cmds[1] then
+        add("command", lousy.bind.cmd(spec.cmds, function (w, a, o)
+            load(name)
+            return w:match_cmd(o.cmd)
+        end))
+    end
+
+    for mode, keys in pairs(spec.keys or {}) do
+        for _, k in ipairs(keys) do
+            add(mode, lousy.bind.key(k[1], k[2], function (w, o)
+                load(name)
+                update_binds(w)
+                return lousy.bind.match_key(w, w.binds, o.mask or o.mods, o.key, o)
+            end))
+        end
+    end
+
+    for mode, bufs in pairs(spec.bufs or {}) do
+        for _, pattern in ipairs(bufs) do
+            add(mode, lousy.bind.buf(pattern, function (w, b, o)
+                load(name)
+                update_binds(w)
+                return lousy.bind.match_buf(w, w.binds, b, o)
+            end))
+        end
+    end
+end
+
+-- vim: et:sw=4:ts=8:sts=4:tw=80
@@ -6,6 +6,7 @@
 --- Grab environment we need
 local assert = assert
 local ipairs = ipairs
+local next = next
 local pairs = pairs
 local setmetatable = setmetatable
 local string = string
@@ -13,7 +14,9 @@ local table = table
 local type = type
 local unpack = unpack
 local util = require("lousy.util")
+local prefix = require("lousy.prefix")
 local join = util.table.join
+local clone = util.table.clone
 local print = print
 
 --- Key, buffer and command binding functions.
@@ -27,6 +30,46 @@ map = {
     ISO_Left_Tab = "Tab",
 }
 
+--- Bit values of the modifiers in a modifier mask. These are the same as
+-- GDK's modifier mask bits, unknown modifiers are assigned the next free bit.
+mod_bits = {
+    Shift = 1, Lock = 2, Control = 4, Mod1 = 8,
+    Mod2 = 16, Mod3 = 32, Mod4 = 64, Mod5 = 128,
+}
+local next_bit = 256
+
+--- Convert a table of modifier names into a modifier mask. Ignored modifiers
+-- are left out. Does not allocate any tables.
+-- @param mods The table of modifiers or a modifier mask (see
+-- `luapdf.modifier_mask`).
+-- @param remove_shift Leave out the Shift key (Normally done if the key
+-- pressed is a single character)
+-- @return The modifier mask
+function mods_mask(mods, remove_shift)
+    if type(mods) == "number" then
+        local mask = mods
+        for _, m in ipairs(ignore_modifiers) do
+            local bit = mod_bits[m]
+            if bit and mask % (bit * 2) >= bit then mask = mask - bit end
+        end
+        if remove_shift and mask % 2 == 1 then mask = mask - 1 end
+        return mask
+    end
+    local mask = 0
+    for _, m in ipairs(mods) do
+        local bit = mod_bits[m]
+        if not bit then
+            bit, next_bit = next_bit, next_bit * 2
+            mod_bits[m] = bit
+        end
+        if mask % (bit * 2) < bit and not (remove_shift and m == "Shift")
+            and not util.table.hasitem(ignore_modifiers, m) then
+            mask = mask + bit
+        end
+    end
+    return mask
+end
+
 --- Return cloned, sorted & filtered modifier mask table.
 -- @param mods The table of modifiers
 -- @param remove_shift Remove Shift key from modifiers table (Normally done if
@@ -58,6 +101,7 @@ function key(mods, key, func, opts)
     return {
         type = "key",
         mods = filter_mods(mods, #key == 1), -- Remove Shift key for char keys
+        mask = mods_mask(mods, #key == 1),
         key  = key,
         func = func,
         opts = opts or {},
@@ -78,6 +122,7 @@ function but(mods, button, func, opts)
     return {
         type   = "button",
         mods   = filter_mods(mods), -- Sort modifiers
+        mask   = mods_mask(mods),
         button = button,
         func   = func,
         opts   = opts or {},
@@ -143,6 +188,80 @@ function any(func, opts)
     }
 end
 
+-- Compiled bind indexes, keyed by the binds table they were built from.
+local indexes = setmetatable({}, { __mode = "k" })
+
+-- Add binds[from] .. binds[to] to an index.
+local function add_to_index(idx, binds, from, to)
+    for i = from, to do
+        local b = binds[i]
+        if b.type == "key" or b.type == "button" then
+            local t, k = idx.keys, b.key
+            if b.type == "button" then t, k = idx.buttons, b.button end
+            local mask = b.mask or mods_mask(b.mods, b.type == "key" and #k == 1)
+            t[k] = t[k] or {}
+            t[k][mask] = t[k][mask] or {}
+            table.insert(t[k][mask], b)
+        elseif b.type == "command" then
+            for _, name in ipairs(b.cmds) do
+                local list = idx.cmds[name]
+                if not list then
+                    list = {}
+                    idx.cmds[name] = list
+                    idx.names:insert(name, list)
+                end
+                table.insert(list, i)
+            end
+        elseif b.type == "buffer" or b.type == "any" then
+            table.insert(idx.others, i)
+            if b.type == "any" then table.insert(idx.any, b) end
+        end
+    end
+    idx.n, idx.last = to, binds[to]
+end
+
+--- Return the lookup index of a table of binds. Key and button binds are
+-- indexed by their key or button and modifier mask, keeping the order of the
+-- binds table for binds with the same key and mask. The index is cached and
+-- updated when binds were appended to the table (or rebuilt when the table
+-- changed otherwise).
+-- @param binds The table of binds.
+-- @return The index with the fields `keys` (`keys[key][mask]` is an array of
+-- binds), `buttons` (`buttons[button][mask]`), `any` (an array of any binds),
+-- `cmds` (`cmds[name]` is an array of the positions of the command binds with
+-- that name), `others` (the positions of all buffer and any binds) and
+-- `names` (a `lousy.prefix` tree of all command names).
+function index(binds)
+    local idx, n = indexes[binds], #binds
+    if idx and idx.n == n and idx.last == binds[n] then return idx end
+
+    if not idx or idx.n > n or idx.last ~= binds[idx.n] then
+        idx = { n = 0, keys = {}, buttons = {}, any = {}, cmds = {},
+            others = {}, names = prefix.new() }
+        indexes[binds] = idx
+    end
+    add_to_index(idx, binds, idx.n + 1, n)
+    return idx
+end
+
+-- Returns the args table of a bind callback. Most binds have no options and
+-- get the args table itself, only options are merged into a new table.
+local function bind_args(b, args)
+    if next(b.opts) == nil then return args end
+    return join(b.opts, args)
+end
+
+-- Call the binds in the array until one of them does not return false.
+local function call_binds(list, object, args)
+    if not list then return false end
+    for _, b in ipairs(list) do
+        if b.func(object, bind_args(b, args)) ~= false then
+            return true
+        end
+    end
+    return false
+end
+
 --- Try and match an any binding.
 -- @param object The first argument of the bind callback function.
 -- @param binds The table of binds in which to check for a match.
@@ -150,53 +269,35 @@ end
 -- opts table given when the bind was created.
 -- @return True if a binding was matched and called.
 function match_any(object, binds, args)
-    for _, b in ipairs(binds) do
-        if b.type == "any" then
-            if b.func(object, join(b.opts, args)) ~= false then
-                return true
-            end
-        end
-    end
-    return false
+    return call_binds(index(binds).any, object, args)
 end
+
 --- Try and match a key binding in a given table of bindings and call that
 -- bindings callback function.
 -- @param object The first argument of the bind callback function.
 -- @param binds The table of binds in which to check for a match.
--- @param mods The modifiers to match.
+-- @param mods The modifiers table or modifier mask to match.
 -- @param key The key name to match.
 -- @param args The bind options/state/metadata table which is applied over the
 -- opts table given when the bind was created.
 -- @return True if a binding was matched and called.
 function match_key(object, binds, mods, key, args)
-    for _, b in ipairs(binds) do
-        if b.type == "key" and b.key == key and util.table.isclone(b.mods, mods) then
-            if b.func(object, join(b.opts, args)) ~= false then
-                return true
-            end
-        end
-    end
-    return false
+    local masks = index(binds).keys[key]
+    return call_binds(masks and masks[mods_mask(mods, #key == 1)], object, args)
 end
 
 --- Try and match a button binding in a given table of bindings and call that
 -- bindings callback function.
 -- @param object The first argument of the bind callback function.
 -- @param binds The table of binds in which to check for a match.
--- @param mods The modifiers to match.
+-- @param mods The modifiers table or modifier mask to match.
 -- @param button The mouse button number to match.
 -- @param args The bind options/state/metadata table which is applied over the
 -- opts table given when the bind was created.
 -- @return True if a binding was matched and called.
 function match_but(object, binds, mods, button, args)
-    for _, b in ipairs(binds) do
-        if b.type == "button" and b.button == button and util.table.isclone(b.mods, mods) then
-            if b.func(object, join(b.opts, args)) ~= false then
-                return true
-            end
-        end
-    end
-    return false
+    local masks = index(binds).buttons[button]
+    return call_binds(masks and masks[mods_mask(mods)], object, args)
 end
 
 --- Try and match a buffer binding in a given table of bindings and call that
@@ -212,11 +313,11 @@ function match_buf(object, binds, buffer, args)
 
     for _, b in ipairs(binds) do
         if b.type == "buffer" and string.match(buffer, b.pattern) then
-            if b.func(object, buffer, join(b.opts, args)) ~= false then
+            if b.func(object, buffer, bind_args(b, args)) ~= false then
                 return true
             end
         --elseif b.type == "any" then
-        --    if b.func(object, join(b.opts, args)) ~= false then
+        --    if b.func(object, bind_args(b, args)) ~= false then
         --        return true
         --    end
         end
@@ -246,20 +347,32 @@ function match_cmd(object, binds, buffer, args)
         cmd = buffer,
     })
 
-    for _, b in ipairs(binds) do
+    -- Walk the command binds of the command and all buffer and any binds in
+    -- the order of the binds table
+    local idx = index(binds)
+    local cmds, others = idx.cmds[command] or {}, idx.others
+    local c, o = 1, 1
+    while cmds[c] or others[o] do
+        local pos
+        if not others[o] or (cmds[c] and cmds[c] < others[o]) then
+            pos, c = cmds[c], c + 1
+        else
+            pos, o = others[o], o + 1
+        end
+        local b = binds[pos]
         -- Command matching
-        if b.type == "command" and util.table.hasitem(b.cmds, command) then
-            if b.func(object, argument, join(b.opts, args)) ~= false then
+        if b.type == "command" then
+            if b.func(object, argument, bind_args(b, args)) ~= false then
                 return true
             end
         -- Buffer matching
         elseif b.type == "buffer" and string.match(buffer, b.pattern) then
-            if b.func(object, buffer, join(b.opts, args)) ~= false then
+            if b.func(object, buffer, bind_args(b, args)) ~= false then
                 return true
             end
         -- Any matching
         elseif b.type == "any" then
-            if b.func(object, join(b.opts, args)) ~= false then
+            if b.func(object, bind_args(b, args)) ~= false then
                 return true
             end
         end
@@ -272,10 +385,12 @@ end
 -- necessary and the buffer is enabled.
 -- @param object The first argument of the bind callback function.
 -- @param binds The table of binds in which to check for a match.
--- @param mods The modifiers to match.
+-- @param mods The modifiers table or modifier mask to match.
 -- @param key The key name to match.
 -- @param args The bind options/state/metadata table which is applied over the
--- opts table given when the bind was created.
+-- opts table given when the bind was created. It is copied once and the copy
+-- gets the `object`, `binds`, `mods`, `mask` and `key` fields. Binds without
+-- options share that copy.
 -- @return True if a key or buffer binding was matched or if a key was added to
 -- the buffer.
 -- @return The new buffer truncated to 10 characters (if you need more buffer
@@ -284,39 +399,39 @@ function hit(object, binds, mods, key, args)
     -- Convert keys using map
     key = map[key] or key
 
-    -- Filter modifers table
-    mods = filter_mods(mods, type(key) == "string" and #key == 1)
-    len = string.wlen(key)
+    -- Filter modifiers
+    local mask = mods_mask(mods, type(key) == "string" and #key == 1)
+    local len = string.wlen(key)
 
     -- Compile metadata table
-    args = join(args or {}, {
-        object = object,
-        binds  = binds,
-        mods   = mods,
-        key    = key,
-    })
+    args = args and clone(args) or {}
+    args.object = object
+    args.binds  = binds
+    args.mods   = mods
+    args.mask   = mask
+    args.key    = key
 
     if match_any(object, binds, args) then
         return true
 
     -- Match button bindings
     elseif type(key) == "number" then
-        if match_but(object, binds, mods, key, args) then
+        if match_but(object, binds, mask, key, args) then
             return true
         end
         return false
 
     -- Match key bindings
-    elseif (not args.buffer or not args.enable_buffer) or #mods ~= 0 or len ~= 1 then
+    elseif (not args.buffer or not args.enable_buffer) or mask ~= 0 or len ~= 1 then
         -- Check if the current buffer affects key bind (I.e. if the key has a
         -- `[count]` prefix)
-        if match_key(object, binds, mods, key, args) then
+        if match_key(object, binds, mask, key, args) then
             return true
         end
     end
 
     -- Clear buffer
-    if not args.enable_buffer or #mods ~= 0 then
+    if not args.enable_buffer or mask ~= 0 then
         return false
 
     -- Else match buffer
@@ -6,8 +6,10 @@
 require("lousy.util")
 require("lousy.bind")
 require("lousy.mode")
+require("lousy.prefix")
 require("lousy.theme")
 require("lousy.signal")
+require("lousy.tasks")
 require("lousy.widget")
 
 --- Useful functions for luapdf.
@@ -0,0 +1,155 @@
+---------------------------------------------------------------------------
+-- @author Mason Larobina &lt;mason.larobina@gmail.com&gt;
+-- @copyright 2010 Mason Larobina
+---------------------------------------------------------------------------
+
+--- Grab environment we need
+local ipairs = ipairs
+local floor = math.floor
+local setmetatable = setmetatable
+local string = string
+local table = table
+
+--- Prefix trees of strings for incremental completion.
+-- Children of a node are keyed by byte value and kept in byte order, so
+-- matches come out sorted independently of the current locale.
+module("lousy.prefix")
+
+local meta = { __index = _M }
+
+--- Create a new, empty prefix tree.
+-- @return The prefix tree.
+function new()
+    return setmetatable({ root = { size = 0, bytes = {} } }, meta)
+end
+
+-- Insert a byte into the sorted array of child bytes of a node.
+local function add_byte(node, byte)
+    local bytes = node.bytes
+    local lo, hi = 1, #bytes + 1
+    while lo < hi do
+        local mid = floor((lo + hi) / 2)
+        if bytes[mid] < byte then lo = mid + 1 else hi = mid end
+    end
+    table.insert(bytes, lo, byte)
+end
+
+-- Remove a byte from the sorted array of child bytes of a node.
+local function remove_byte(node, byte)
+    for i, b in ipairs(node.bytes) do
+        if b == byte then return table.remove(node.bytes, i) end
+    end
+end
+
+--- Add a string or replace the value stored with it.
+-- @param tree The prefix tree.
+-- @param key The string to add.
+-- @param value The value to store with the string (defaults to true).
+function insert(tree, key, value)
+    if value == nil then value = true end
+    local node = tree.root
+    local path = {}
+    for i = 1, #key do
+        local byte = string.byte(key, i)
+        local child = node[byte]
+        if not child then
+            child = { size = 0, bytes = {} }
+            node[byte] = child
+            add_byte(node, byte)
+        end
+        path[i] = node
+        node = child
+    end
+    if node.key == nil then
+        node.key = key
+        node.size = node.size + 1
+        for _, n in ipairs(path) do n.size = n.size + 1 end
+    end
+    node.value = value
+end
+
+--- Remove a string, pruning nodes that lead to no other string.
+-- @param tree The prefix tree.
+-- @param key The string to remove.
+-- @return The value that was stored with the string or nil.
+function remove(tree, key)
+    local node = tree.root
+    local path = {}
+    for i = 1, #key do
+        path[i] = node
+        node = node[string.byte(key, i)]
+        if not node then return end
+    end
+    if node.key == nil then return end
+    local value = node.value
+    node.key, node.value = nil, nil
+    node.size = node.size - 1
+    for i = #key, 1, -1 do
+        local parent = path[i]
+        parent.size = parent.size - 1
+        if node.size == 0 then
+            local byte = string.byte(key, i)
+            parent[byte] = nil
+            remove_byte(parent, byte)
+        end
+        node = parent
+    end
+    return value
+end
+
+--- Get the value stored with a string.
+-- @param tree The prefix tree.
+-- @param key The string to look up.
+-- @return The value or nil if the string is not in the tree.
+function get(tree, key)
+    local node = tree.root
+    for i = 1, #key do
+        node = node[string.byte(key, i)]
+        if not node then return end
+    end
+    return node.value
+end
+
+--- Return the number of strings in the tree.
+-- @param tree The prefix tree.
+-- @param prefix Only count strings starting with this prefix (optional).
+function count(tree, prefix)
+    local node = tree.root
+    for i = 1, #(prefix or "") do
+        node = node[string.byte(prefix, i)]
+        if not node then return 0 end
+    end
+    return node.size
+end
+
+-- Append the strings below a node in byte order.
+local function collect(node, keys, values, limit)
+    if limit and #keys >= limit then return end
+    if node.key ~= nil then
+        local n = #keys + 1
+        keys[n], values[n] = node.key, node.value
+    end
+    for _, byte in ipairs(node.bytes) do
+        collect(node[byte], keys, values, limit)
+    end
+end
+
+--- Find all strings starting with a prefix. Only the subtree below the
+-- prefix is visited.
+-- @param tree The prefix tree.
+-- @param prefix The prefix to match.
+-- @param limit The maximum number of matches to return (optional).
+-- @return The sorted array of matching strings.
+-- @return The array of their values.
+function match(tree, prefix, limit)
+    local keys, values = {}, {}
+    local node = tree.root
+    for i = 1, #prefix do
+        node = node[string.byte(prefix, i)]
+        if not node then return keys, values end
+    end
+    collect(node, keys, values, limit)
+    return keys, values
+end
+
+-- vim: et:sw=4:ts=8:sts=4:tw=80
@@ -0,0 +1,116 @@
+---------------------------------------------------------------------------
+-- @author Mason Larobina &lt;mason.larobina@gmail.com&gt;
+-- @copyright 2011 Mason Larobina
+---------------------------------------------------------------------------
+
+--- Grab environment we need
+local assert = assert
+local coroutine = coroutine
+local io = io
+local pcall = pcall
+local setmetatable = setmetatable
+local string = string
+local table = table
+local tostring = tostring
+local capi = { luapdf = luapdf }
+
+--- Cooperative background tasks.
+-- A task is a function run in a coroutine from an idle source of its
+-- priority class. Input and redraws are handled before the "default" and
+-- "low" classes, only "high" tasks run before pending redraws. Tasks call
+-- `yield()` regularly, which gives the main loop back once the tasks of the
+-- class have used up their `budget` for this main loop iteration.
+module("lousy.tasks")
+
+--- Microseconds the tasks of a priority class may run per main loop
+-- iteration.
+budget = 4000
+
+-- Queues of runnable tasks by priority class
+local queues = { high = {}, default = {}, low = {} }
+
+-- Priority classes with an idle source
+local scheduled = {}
+
+-- The task running now and the time its slice ends
+local current, deadline
+
+local task_methods = {}
+local task_meta = { __index = task_methods }
+
+--- Cancel a task. It isn't resumed again and its `done` function isn't
+-- called.
+-- @param task The task.
+function task_methods.cancel(task)
+    task.cancelled = true
+end
+
+-- Report an error of a task
+local function warn(task, err)
+    io.stderr:write(string.format("error in task %s: %s\n",
+        task.name or "?", tostring(err)))
+end
+
+-- Resume the tasks of a class round-robin until the budget is used up
+local function run(class)
+    local queue = queues[class]
+    deadline = capi.luapdf.monotonic() + budget
+    while queue[1] do
+        local task = table.remove(queue, 1)
+        if not task.cancelled then
+            current = task
+            local ok, ret = coroutine.resume(task.co)
+            current = nil
+            if not ok then
+                task.finished = true
+                warn(task, ret)
+            elseif coroutine.status(task.co) == "dead" then
+                task.finished = true
+                if task.done then
+                    ok, ret = pcall(task.done, ret)
+                    if not ok then warn(task, ret) end
+                end
+            else
+                table.insert(queue, task)
+            end
+        end
+        if capi.luapdf.monotonic() >= deadline then break end
+    end
+    if queue[1] then return true end
+    scheduled[class] = nil
+    return false
+end
+
+--- Start a task.
+-- @param func The function to run.
+-- @param opts Optional table of options: `priority` is the priority class
+-- ("high", "default" or "low", see `luapdf.idle_add`), `name` names the task
+-- in error messages and `done` is called with the first value returned by
+-- the function once it finished.
+-- @return The task.
+function spawn(func, opts)
+    opts = opts or {}
+    local class = opts.priority or "default"
+    local queue = assert(queues[class], "unknown priority: " .. tostring(class))
+    local task = setmetatable({ co = coroutine.create(func), name = opts.name,
+        done = opts.done }, task_meta)
+    table.insert(queue, task)
+    if not scheduled[class] then
+        scheduled[class] = true
+        capi.luapdf.idle_add(function () return run(class) end, class)
+    end
+    return task
+end
+
+--- Give the main loop back if the slice of the running task is used up.
+-- Does nothing when not called from the coroutine of a task, so functions
+-- calling it can be used synchronously as well. Note that Lua 5.1 can't
+-- yield across pcall or C functions.
+function yield()
+    if current and coroutine.running() == current.co
+        and capi.luapdf.monotonic() >= deadline then
+        coroutine.yield()
+    end
+end
+
+-- vim: et:sw=4:ts=8:sts=4:tw=80
@@ -9,6 +9,7 @@ local setmetatable = setmetatable
 local math = require "math"
 local signal = require "lousy.signal"
 local type = type
+local string = string
 local assert = assert
 local ipairs = ipairs
 local table = table
@@ -19,6 +20,42 @@ module "lousy.widget.menu"
 
 local data = setmetatable({}, { __mode = "k" })
 
+-- Return the number of columns of a row, counted when first needed.
+local function ncols(row)
+    local n = row.ncols
+    if not n then
+        assert(type(row) == "table", "invalid row in rows table")
+        n = #row
+        assert(n >= 1, "empty row")
+        row.ncols = n
+    end
+    return n
+end
+
+-- Return the index of the title row shown in place of the first visible row
+-- when the real title has scrolled off-screen, or false. Results are cached
+-- for every row walked so repeated scrolling doesn't rescan the rows.
+local function title_for(d, index)
+    local cache = d.titles
+    local j = index
+    -- Walk back to a row with a known result
+    while j > 1 and cache[j] == nil do
+        local r, p = d.rows[j], d.rows[j - 1]
+        -- Only check rows with same number of columns
+        if r.title or ncols(p) ~= ncols(r) then
+            cache[j] = false
+        elseif p.title then
+            cache[j] = j - 1
+        else
+            j = j - 1
+        end
+    end
+    local t = cache[j] or false
+    -- Fill in the results of the rows walked over
+    for i = j + 1, index do cache[i] = t end
+    return t
+end
+
 function update(menu)
     assert(data[menu] and type(menu.widget) == "widget", "invalid menu widget")
 
@@ -30,9 +67,6 @@ function update(menu)
     local fg, bg, font = theme.menu_fg, theme.menu_bg, theme.menu_font
     local sfg, sbg = theme.menu_selected_fg, theme.menu_selected_bg
 
-    -- Hide widget while re-drawing
-    menu.widget:hide()
-
     -- Build & populate rows
     for i = 1, math.max(d.max_rows, #(d.table)) do
         -- Get row
@@ -48,6 +82,7 @@ function update(menu)
                 ebox = capi.widget{type = "eventbox"},
                 hbox = capi.widget{type = "hbox"},
                 cols = {},
+                texts = {},
             }
             rw.ebox.child = rw.hbox
             d.table[i] = rw
@@ -75,22 +110,12 @@ function update(menu)
 
             -- Try to find last off-screen title row and replace with current
             if i == 1 and not row.title and d.offset > 1 then
-                local j = d.offset - 1
-                while j > 0 do
-                    local r = d.rows[j]
-                    -- Only check rows with same number of columns
-                    if r.ncols ~= row.ncols then break end
-                    -- Check if title row
-                    if r.title then
-                        row, index = r, j
-                        break
-                    end
-                    j = j - 1
-                end
+                local j = title_for(d, index)
+                if j then row, index = d.rows[j], j end
             end
 
             -- Is this the selected row?
-            selected = not row.title and index == d.cursor
+            local selected = not row.title and index == d.cursor
 
             -- Set row bg
             local rbg
@@ -101,7 +126,7 @@ function update(menu)
             end
             if rw.ebox.bg ~= rbg then rw.ebox.bg = rbg end
 
-            for c = 1, math.max(row.ncols, #(rw.cols)) do
+            for c = 1, math.max(ncols(row), #(rw.cols)) do
                 -- Get column text
                 local text = row[c]
                 text = (type(text) == "function" and text(row)) or text
@@ -120,16 +145,21 @@ function update(menu)
                 elseif not text and cell then
                     rw.hbox:remove(cell)
                     rw.cols[c] = nil
+                    rw.texts[c] = nil
                     cell:destroy()
                 end
 
+                -- Only touch the label if its text changed
+                if text and cell and rw.texts[c] ~= text then
+                    cell.text = text
+                    rw.texts[c] = text
+                end
+
                 -- Set cell props
                 if text and cell and row.title then
-                    cell.text = text
                     local fg = row.fg or (c == 1 and theme.menu_primary_title_fg or theme.menu_secondary_title_fg) or fg
                     if cell.fg ~= fg then cell.fg = fg end
                 elseif text and cell then
-                    cell.text = text
                     local fg = (selected and (row.selected_fg or sfg)) or row.fg or fg
                     if cell.fg ~= fg then cell.fg = fg end
                 end
@@ -140,27 +170,88 @@ function update(menu)
     menu.widget:show()
 end
 
+-- Show a new array of rows (or the filtered view of the rows).
+local function set_rows(menu, rows)
+    local d = data[menu]
+    d.rows = rows
+    d.nrows = #rows
+    d.titles = {}
+
+    -- Initial positions
+    d.cursor = 0
+    d.offset = 1
+
+    update(menu)
+end
+
+--- Show a new array of rows. Rows are only checked when they are first
+-- shown, so building a menu doesn't depend on the number of rows.
+-- @param menu The menu.
+-- @param rows The array of rows.
 function build(menu, rows)
     assert(data[menu] and type(menu.widget) == "widget", "invalid menu widget")
+    assert(type(rows) == "table", "invalid rows table")
 
     -- Get private menu widget data
     local d = data[menu]
+    d.all = rows
+    d.filter = nil
 
-    -- Check rows
-    for i, row in ipairs(rows) do
-        assert(type(row) == "table", "invalid row in rows table")
-        assert(#row >= 1, "empty row")
-        row.ncols = #row
+    set_rows(menu, rows)
+end
+
+-- Return the lower case text of the first column of a row.
+local function row_text(d, row)
+    local text = d.lower[row]
+    if not text then
+        text = row[1]
+        text = (type(text) == "function" and text(row)) or text or ""
+        text = string.lower(text)
+        d.lower[row] = text
     end
+    return text
+end
 
-    d.rows = rows
-    d.nrows = #rows
+--- Only show the rows whose first column contains the given text (ignoring
+-- case). Title rows are kept if any row below them matches. If the text
+-- extends the current filter only the currently shown rows are searched.
+-- @param menu The menu.
+-- @param text The text to search for, nil or "" shows all rows again.
+function filter(menu, text)
+    assert(data[menu] and type(menu.widget) == "widget", "invalid menu widget")
 
-    -- Initial positions
-    d.cursor = 0
-    d.offset = 1
+    -- Get private menu widget data
+    local d = data[menu]
+    text = string.lower(text or "")
 
-    update(menu)
+    if text == (d.filter or "") then return end
+    if text == "" then
+        d.filter = nil
+        return set_rows(menu, d.all)
+    end
+
+    -- Narrow down the current view if possible
+    local source = d.all
+    if d.filter and string.find(text, d.filter, 1, true) == 1 then
+        source = d.rows
+    end
+
+    local rows, title = {}, nil
+    for _, row in ipairs(source) do
+        if row.title then
+            title = row
+        elseif string.find(row_text(d, row), text, 1, true) then
+            if title then
+                rows[#rows + 1] = title
+                title = nil
+            end
+            rows[#rows + 1] = row
+        end
+    end
+
+    d.filter = text
+    set_rows(menu, rows)
+    menu:emit_signal("changed", menu:get())
 end
 
 local function calc_offset(menu)
@@ -243,10 +334,17 @@ function del(menu, index)
     -- Unable to delete this index, return
     if d.cursor < 1 then return end
 
-    table.remove(d.rows, d.cursor)
+    -- Remove the row from the unfiltered rows too
+    local row = table.remove(d.rows, d.cursor)
+    if d.all ~= d.rows then
+        for i, r in ipairs(d.all) do
+            if r == row then table.remove(d.all, i) break end
+        end
+    end
 
     -- Update rows count
     d.nrows = #(d.rows)
+    d.titles = {}
 
     -- Check cursor
     d.cursor = math.min(d.cursor, d.nrows)
@@ -265,6 +363,7 @@ function new(args)
         widget    = capi.widget{type = "vbox"},
         -- Add widget methods
         build     = build,
+        filter    = filter,
         update    = update,
         get       = get,
         del       = del,
@@ -282,6 +381,10 @@ function new(args)
         max_rows = args.max_rows or 10,
         nrows = 0,
         rows = {},
+        all = {},
+        titles = {},
+        -- Lower case text of rows used by filter
+        lower = setmetatable({}, { __mode = "k" }),
     }
 
     -- Setup class signals
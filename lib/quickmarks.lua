@@ -5,7 +5,6 @@
 ----------------------------------------------------------------
 
 -- Get lua environment
-local os = os
 local io = io
 local assert = assert
 local string = string
@@ -24,23 +23,20 @@ local capi = { luapdf = luapdf }
 
 module("quickmarks")
 
-local qmarks
+local qmarks = {}
 local quickmarks_file = capi.luapdf.data_dir .. '/quickmarks'
 
+-- Number of writes of the quickmarks file still in progress
+local writing = 0
+
 local function check_token(token)
     assert(string.match(tostring(token), "^(%w)$"), "invalid token: " .. tostring(token))
     return token
 end
 
---- Load quick bookmarks from storage file into memory
--- @param fd_name bookmarks storage file path of nil to use default one
-function load(fd_name)
-    if not qmarks then qmarks = {} end
-
-    local fd_name = fd_name or quickmarks_file
-    if not os.exists(fd_name) then return end
-
-    for line in io.lines(fd_name) do
+-- Add the quickmarks of the contents of a quickmarks file
+local function parse(contents)
+    for line in string.gmatch(contents, "[^\n]+") do
         local token, uris = string.match(lousy.util.string.strip(line), "^(%w)%s+(.+)$")
         if token then
             qmarks [token] = lousy.util.string.split(uris, ",%s+")
@@ -48,33 +44,54 @@ function load(fd_name)
     end
 end
 
---- Save quick bookmarks to file
+--- Load quick bookmarks from storage file into memory. The file is read in
+-- the background.
 -- @param fd_name bookmarks storage file path of nil to use default one
-function save(fd_name)
-    -- Quickmarks init check
-    if not qmarks then load() end
+-- @param callback Optional function called once the quickmarks are loaded
+function load(fd_name, callback)
+    local fd_name = fd_name or quickmarks_file
+    capi.luapdf.fs.read_file(fd_name, function (contents)
+        -- The quickmarks in memory are newer than the file while it's written
+        if contents and not (fd_name == quickmarks_file and writing > 0) then
+            parse(contents)
+        end
+        if callback then callback() end
+    end)
+end
 
-    local fd = io.open(fd_name or quickmarks_file, "w")
+--- Save quick bookmarks to file (in the background)
+-- @param fd_name bookmarks storage file path of nil to use default one
+function save(fd_name)
+    local lines = {}
     for _, token in ipairs(lousy.util.table.keys(qmarks )) do
         local uris = table.concat(qmarks [token], ", ")
-        fd:write(string.format("%s %s\n", token, uris))
+        table.insert(lines, string.format("%s %s\n", token, uris))
     end
-    io.close(fd)
+
+    -- Write without blocking the main loop
+    local file = fd_name or quickmarks_file
+    writing = writing + 1
+    capi.luapdf.fs.write_file(file, table.concat(lines), function (ok, err)
+        writing = writing - 1
+        if not ok then io.stderr:write("unable to save quickmarks: " .. err .. "\n") end
+    end)
 end
 
 --- Return url related to given key or nil if does not exist
 -- @param token quick bookmarks mapping token
--- @param load_file Call quickmark.load() before get
+-- @param load_file Call quickmark.load() after get, so later calls see the
+-- quickmarks of other sessions
 function get(token, load_file)
+    local uris = qmarks[check_token(token)]
+
     -- Load quickmarks from other sessions
-    if not qmarks or load_file ~= false then load() end
+    if load_file ~= false then load() end
 
-    return qmarks[check_token(token)]
+    return uris
 end
 
 --- Return a list of all the tokens in the quickmarks table
 function get_tokens()
-    if not qmarks then load() end
     return lousy.util.table.keys(qmarks )
 end
 
@@ -84,8 +101,7 @@ end
 -- @param load_file Call quickmark.load() before set
 -- @param save_file Call quickmark.save() after set
 function set(token, uris, load_file, save_file)
-    -- Load quickmarks from other sessions
-    if not qmarks or load_file ~= false then load() end
+    check_token(token)
 
     -- Parse uris: "http://forum1.com, google.com, imdb some artist"
     if uris and type(uris) == "string" then
@@ -94,10 +110,15 @@ function set(token, uris, load_file, save_file)
         error("invalid locations type: ", type(uris))
     end
 
-    qmarks[check_token(token)] = uris
+    local function apply()
+        qmarks[token] = uris
 
-    -- By default, setting new quickmark saves them to
-    if save_file ~= false then save() end
+        -- By default, setting new quickmark saves them to
+        if save_file ~= false then save() end
+    end
+
+    -- Load quickmarks from other sessions
+    if load_file ~= false then load(nil, apply) else apply() end
 end
 
 --- Delete a quickmark
@@ -105,11 +126,15 @@ end
 -- @param load_file Call quickmark.load() before deletion
 -- @param save_file Call quickmark.save() after deletion
 function del(token, load_file, save_file)
-    -- Load quickmarks from other sessions
-    if not qmarks or load_file ~= false then load() end
+    check_token(token)
 
-    qmarks[check_token(token)] = nil
-    if save_file ~= false then save() end
+    local function apply()
+        qmarks[token] = nil
+        if save_file ~= false then save() end
+    end
+
+    -- Load quickmarks from other sessions
+    if load_file ~= false then load(nil, apply) else apply() end
 end
 
 --- Delete all quickmarks
@@ -119,6 +144,17 @@ function delall(save_file)
     if save_file ~= false then save() end
 end
 
+-- Read the quickmarks of earlier sessions right away, so the first use of a
+-- quickmark finds them. The file holds a few short lines; later re-reads
+-- and all writes run in the background.
+do
+    local fd = io.open(quickmarks_file)
+    if fd then
+        parse(fd:read("*a") or "")
+        fd:close()
+    end
+end
+
 -- Add quickmarking binds to normal mode
 local buf = lousy.bind.buf
 add_binds("normal", {
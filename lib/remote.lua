@@ -0,0 +1,123 @@
+------------------------------------------------------------
+-- Commands for luapdfc and other ipc clients             --
+-- © 2011 Mason Larobina  <mason.larobina@gmail.com>      --
+------------------------------------------------------------
+
+-- Get Lua environment
+local error = error
+local loadstring = loadstring
+local pairs = pairs
+local pcall = pcall
+local select = select
+local string = string
+local table = table
+local tostring = tostring
+
+-- Get luapdf environment
+local lfs = require "lfs"
+local window = window
+
+--- Answers requests sent over the ipc socket (see `ipc.listen`).
+-- A request is a command name optionally followed by a space and an argument,
+-- the reply is "+" followed by the result or "-" followed by an error
+-- message. Any number of requests can be sent over one connection, every
+-- request gets exactly one reply in order.
+module "remote"
+
+-- Return any window to open documents in or nil
+local function get_window()
+    for _, w in pairs(window.bywidget) do return w end
+end
+
+-- Check that a document path is absolute and exists
+local function check_path(path)
+    if not string.match(path, "^/") then
+        error("not an absolute path: " .. path, 0)
+    end
+    if not lfs.attributes(path) then
+        error("no such file: " .. path, 0)
+    end
+    return path
+end
+
+-- Collect all values including trailing nils
+local function pack(...)
+    return { n = select("#", ...), ... }
+end
+
+-- Return the current document or raise an error
+local function get_doc(w)
+    local doc = w and w:get_current()
+    if not doc then error("no document open", 0) end
+    return doc
+end
+
+--- The request handlers indexed by command name. A handler is called with a
+-- window (or nil if there are no windows) and the argument string. Its return
+-- value is the result, errors become failure replies.
+commands = {
+    -- Open a document in a new tab
+    tabopen = function (w, arg)
+        local path = check_path(arg)
+        if w then w:new_tab(path) else window.new({ path }) end
+    end,
+
+    -- Open a new window, with a document if one is given
+    winopen = function (w, arg)
+        window.new(arg ~= "" and { check_path(arg) } or {})
+    end,
+
+    -- The paths of all open documents, one per line
+    paths = function (w)
+        local paths = {}
+        for _, w in pairs(window.bywidget) do
+            for i = 1, w.tabs:count() do
+                table.insert(paths, w.tabs[i].path)
+            end
+        end
+        table.sort(paths)
+        return table.concat(paths, "\n")
+    end,
+
+    -- The path, current page and number of pages of the current document
+    page = function (w)
+        local doc = get_doc(w)
+        return string.format("%d/%d %s", doc.current_page or 0, #doc.pages,
+            doc.path or "")
+    end,
+
+    -- Run a Lua chunk with the window as local `w`, return its results
+    -- separated by tabs
+    eval = function (w, code)
+        local func, err = loadstring("local w = ... " .. code, "=ipc")
+        if not func then error(err, 0) end
+        local ret = pack(func(w))
+        for i = 1, ret.n do ret[i] = tostring(ret[i]) end
+        return table.concat(ret, "\t", 1, ret.n)
+    end,
+}
+
+--- Commands which run arbitrary code and are only answered when the client
+-- runs as the same user (see `handle`).
+trusted_commands = { eval = true }
+
+--- Handle one request and return the reply.
+-- @param msg The request line.
+-- @param trusted Whether the client runs as the same user, the second
+-- argument of the ipc "message" signal.
+-- @return The reply line.
+function handle(msg, trusted)
+    local cmd, arg = string.match(msg, "^(%S+) ?(.*)$")
+    local func = commands[cmd or ""]
+    if not func then
+        return "-unknown command: " .. (cmd or "")
+    end
+    if trusted_commands[cmd] and trusted ~= true then
+        return "-permission denied: " .. cmd
+    end
+    local ok, ret = pcall(func, get_window(), arg)
+    if not ok then return "-" .. tostring(ret) end
+    return "+" .. tostring(ret or "")
+end
+
+-- vim: et:sw=4:ts=8:sts=4:tw=80
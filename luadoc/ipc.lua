@@ -0,0 +1,36 @@
+--- luapdf local socket IPC. The lib is missing when luapdf was started with
+-- --nounique. The requests answered by the stock configuration are
+-- implemented in lib/remote.lua.
+-- @copyright 2011 Mason Larobina
+module("ipc")
+
+--- Start serving requests on a Unix domain socket. Every request line is
+-- emitted as the "message" signal, the first value returned by a handler is
+-- sent back as the reply line. The second argument of the signal tells
+-- whether the client runs as the same user (checked with SO_PEERCRED right
+-- before the signal is emitted), requests running code must be refused
+-- otherwise.
+-- @param path The socket path (default: `ipc.path()`).
+-- @return true or nil and an error message if another instance is listening
+-- or the socket can't be created.
+-- @name listen
+-- @class function
+
+--- Send requests to a listening instance and wait for the replies.
+-- @param request A request string or an array of request strings.
+-- @param path The socket path (default: `ipc.path()`).
+-- @return The reply (or an array of replies) or nil and an error message.
+-- @name send
+-- @class function
+
+--- Check whether an instance is listening.
+-- @param path The socket path (default: `ipc.path()`).
+-- @name is_running
+-- @class function
+
+--- Return the socket path: the one listened on or the default
+-- `$XDG_RUNTIME_DIR/luapdf.sock` (`/tmp/luapdf-UID/luapdf.sock` without
+-- `XDG_RUNTIME_DIR`, nil if that directory isn't private to the user).
+-- Sockets and peers of other users are never talked to.
+-- @name path
+-- @class function
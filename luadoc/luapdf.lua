@@ -9,6 +9,26 @@ module("luapdf")
 -- @field data_dir data directory path (default: XDG_DATA_HOME)
 -- @field cache_dir cache directory path (default: XDG_CACHE_HOME)
 -- @field verbose verbosity (boolean value)
+-- @field profile collect Lua/C bridge statistics (boolean value, also enabled
+-- by the --profile command line option)
+-- @field modifier_mask pass the modifiers of key and button events as an
+-- integer mask (using GDK's bit values) instead of a table of names. All
+-- modifiers are passed, lousy.bind leaves out its ignore_modifiers when it
+-- matches the mask (boolean value)
+-- @field memory_limit bytes documents may hold before background documents
+-- are evicted, 0 disables eviction (default: 256 MiB)
+-- @field hibernate_timeout seconds after which documents that are not shown
+-- release everything but their path, password, zoom and scroll position, 0
+-- disables hibernation (default: 1800). Hibernated documents are restored
+-- when they are shown again.
+-- @field mmap_limit documents up to this size in bytes are memory-mapped
+-- instead of being streamed from disk, 0 disables mapping (default: 0).
+-- Writable files are copied into memory instead, as a file rewritten while
+-- mapped would crash luapdf.
+-- @field daemon whether luapdf was started with --daemon and keeps running
+-- without windows to serve ipc requests (read only property)
+-- @field nounique whether luapdf was started with --nounique, which leaves the
+-- ipc lib out (read only property)
 -- @field install_path luapdf installation path (read only property)
 -- @field version luapdf version (read only property)
 -- @class table
@@ -54,3 +74,58 @@ module("luapdf")
 -- @name get_special_dir
 -- @class function
 
+--- Memory statistics (read only property)
+-- @field total bytes held by all documents
+-- @field limit the current memory_limit
+-- @field clients an array of tables with the fields name (document path),
+-- bytes, visible (boolean) and idle (seconds since last use)
+-- @class table
+-- @name memory
+
+--- Get the statistics collected while luapdf.profile is enabled
+-- @return An array of tables with the fields kind ('signal', 'handler',
+-- 'index' or 'newindex'), name, calls, total and max (seconds), sorted by
+-- total time spent. Handler entries also have a signal field.
+-- @name profile_report
+-- @class function
+
+--- Get the time of a monotonic clock in microseconds. It never jumps when the
+-- system time is changed, use it to measure intervals.
+-- @name monotonic
+-- @class function
+
+--- Write a human readable profiler report sorted by total time spent
+-- @param path File to write the report to (default: stderr).
+-- @name profile_dump
+-- @class function
+
+--- Throw away all collected profiler statistics
+-- @name profile_reset
+-- @class function
+
+--- Begin a nested event in the startup trace written by
+-- `luapdf --trace-startup`. Does nothing if the startup isn't traced.
+-- @param name The name of the event.
+-- @param category The category of the event (default: "lua").
+-- @name trace_begin
+-- @class function
+
+--- End the innermost event of the startup trace.
+-- @name trace_end
+-- @class function
+
+--- Asynchronous file I/O. Every function returns at once and calls its
+-- callback from the main loop with the result or nil and an error message.
+-- All operations run in the order they were started on a single worker
+-- thread and are finished before luapdf exits.
+-- <ul>
+-- <li>`fs.read_file(path, callback)` reads a whole file</li>
+-- <li>`fs.write_file(path, data, [callback])` atomically replaces a file</li>
+-- <li>`fs.append(path, data, [callback])` appends to a file</li>
+-- <li>`fs.stat(path, callback)` gets a table with the `type` ("file",
+-- "directory" or "other"), `size`, `mtime` and `mode` of a file</li>
+-- <li>`fs.list_dir(path, callback)` gets the sorted entry names of a
+-- directory</li>
+-- </ul>
+-- @name fs
+-- @class table
@@ -0,0 +1,41 @@
+--- luapdf asynchronous child processes. A process never blocks the main loop:
+-- its output is emitted in chunks as it arrives.
+--
+-- <pre>
+-- local p = process{ command = { "pdftotext", path, "-" } }
+-- local text = {}
+-- p:add_signal("stdout", function (p, chunk) table.insert(text, chunk) end)
+-- p:add_signal("exit", function (p, reason, status) ... end)
+-- p:start()
+-- </pre>
+--
+-- Signals: "stdout" and "stderr" receive a chunk of output, "exit" receives
+-- the exit reason ("exit", "signal" or "unknown") and the exit code or signal
+-- number. "exit" is emitted after the last chunk of output.
+-- @copyright 2011 Mason Larobina
+module("process")
+
+--- @field command the command, either a string which is split like a shell
+-- would or an array of the program and its arguments
+-- @field pid the pid of the child while it runs (read only property)
+-- @field running whether the child is running (read only property)
+-- @class table
+-- @name process
+
+--- Start the child process.
+-- @name start
+-- @class function
+
+--- Queue data to be written to the stdin of the child.
+-- @param data The string to write.
+-- @name write
+-- @class function
+
+--- Close the stdin of the child once all queued data is written.
+-- @name close_stdin
+-- @class function
+
+--- Send a signal to the child to cancel it.
+-- @param signal The signal number (default: SIGTERM).
+-- @name kill
+-- @class function
@@ -0,0 +1,28 @@
+--- luapdf timers. A timer emits the "timeout" signal every `interval`
+-- milliseconds after it was started.
+--
+-- <pre>
+-- local t = timer{ interval = 5000, tolerance = 1000 }
+-- t:add_signal("timeout", function (t) ... end)
+-- t:start()
+-- </pre>
+-- @copyright 2010 Fabian Streitel, Mason Larobina
+module("timer")
+
+--- @field interval the interval in milliseconds
+-- @field tolerance milliseconds the timeout may be delayed so that it can be
+-- run together with other timers (default: 0). Timers with a tolerance of a
+-- second or more are scheduled with a granularity of whole seconds (the
+-- interval is rounded up). Takes effect the next time the timer is started.
+-- @field single_shot whether the timer stops after the first timeout
+-- @field started whether the timer is running (read only property)
+-- @class table
+-- @name timer
+
+--- Start the timer.
+-- @name start
+-- @class function
+
+--- Stop the timer.
+-- @name stop
+-- @class function
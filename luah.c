@@ -20,16 +20,26 @@
  */
 
 #include "luah.h"
+#include "common/bytecode.h"
+#include "common/trace.h"
 
 /* include clib headers */
+#include "clib/fs.h"
+#include "clib/process.h"
 #include "clib/timer.h"
 #include "clib/widget.h"
 #include "clib/luapdf.h"
-#include "clib/unique.h"
+#include "clib/ipc.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
 
+/* Modifiers kept in integer masks. All of them are passed, lousy.bind leaves
+ * out its ignore_modifiers when it matches the mask. */
+#define LUAPDF_MODIFIER_MASK \
+    (GDK_SHIFT_MASK | GDK_LOCK_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK \
+     | GDK_MOD2_MASK | GDK_MOD3_MASK | GDK_MOD4_MASK | GDK_MOD5_MASK)
+
 void
 luaH_modifier_table_push(lua_State *L, guint state) {
     gint i = 1;
@@ -56,6 +66,17 @@ luaH_modifier_table_push(lua_State *L, guint state) {
     }
 }
 
+/* Push the modifier state of an event, either as a table of modifier names
+ * or, if luapdf.modifier_mask is set, as an integer mask of the same
+ * modifiers (see LUAPDF_MODIFIER_MASK). */
+void
+luaH_modifiers_push(lua_State *L, guint state) {
+    if (globalconf.modifier_mask)
+        lua_pushinteger(L, state & LUAPDF_MODIFIER_MASK);
+    else
+        luaH_modifier_table_push(L, state);
+}
+
 void
 luaH_keystr_push(lua_State *L, guint keyval)
 {
@@ -363,11 +384,12 @@ luaH_init(void)
     /* Export luapdf lib */
     luapdf_lib_setup(L);
 
-#if WITH_UNIQUE
+    /* Export luapdf.fs */
+    fs_lib_setup(L);
+
     if (!globalconf.nounique)
-        /* Export unique lib */
-        unique_lib_setup(L);
-#endif
+        /* Export ipc lib */
+        ipc_lib_setup(L);
 
     /* Export widget */
     widget_class_setup(L);
@@ -375,6 +397,9 @@ luaH_init(void)
     /* Export timer */
     timer_class_setup(L);
 
+    /* Export process */
+    process_class_setup(L);
+
     /* add Lua search paths */
     lua_getglobal(L, "package");
     if(LUA_TTABLE != lua_type(L, 1)) {
@@ -432,6 +457,12 @@ luaH_init(void)
 
     /* remove package module from stack */
     lua_pop(L, 1);
+
+    /* load modules through the bytecode cache */
+    luaH_bytecode_setup(L);
+
+    /* record loading modules in the startup trace */
+    luaH_trace_setup(L);
 }
 
 gboolean
@@ -439,7 +470,7 @@ luaH_loadrc(const gchar *confpath, gboolean run)
 {
     debug("Loading rc: %s", confpath);
     lua_State *L = globalconf.L;
-    if(!luaL_loadfile(L, confpath)) {
+    if(!luaH_loadfile_cached(L, confpath)) {
         if(run) {
             if(lua_pcall(L, 0, LUA_MULTRET, 0)) {
                 g_fprintf(stderr, "%s\n", lua_tostring(L, -1));
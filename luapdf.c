@@ -19,24 +19,18 @@
  */
 
 #include "globalconf.h"
+#include "common/profile.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "luah.h"
 
 #include <gtk/gtk.h>
 #include <signal.h>
 #include <stdlib.h>
-#include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
 #include <locale.h>
 
-static void sigchld(int sigint);
-
-void
-sigchld(int UNUSED(signum)) {
-    while(0 < waitpid(-1, NULL, WNOHANG));
-}
-
 void
 init_lua(gchar **uris)
 {
@@ -71,6 +65,15 @@ init_directories(void)
     g_mkdir_with_parents(globalconf.data_dir,   0771);
 }
 
+/* enable startup tracing, the file argument is optional */
+static gboolean
+trace_startup_cb(const gchar *UNUSED(name), const gchar *value,
+        gpointer UNUSED(data), GError **UNUSED(error))
+{
+    trace_init(value);
+    return TRUE;
+}
+
 /* load command line options into luapdf and return uris to load */
 gchar**
 parseopts(int argc, gchar *argv[], gboolean **nonblock) {
@@ -82,17 +85,22 @@ parseopts(int argc, gchar *argv[], gboolean **nonblock) {
     /* save luapdf exec path */
     globalconf.execpath = g_strdup(argv[0]);
     globalconf.nounique = FALSE;
+    globalconf.mmap_limit = LUAPDF_DEFAULT_MMAP_LIMIT;
 
     /* define command line options */
     const GOptionEntry entries[] = {
-      { "check",    'k', 0, G_OPTION_ARG_NONE,         &check_only,          "check config and exit",     NULL   },
-      { "config",   'c', 0, G_OPTION_ARG_STRING,       &globalconf.confpath, "configuration file to use", "FILE" },
-      { "nonblock", 'n', 0, G_OPTION_ARG_NONE,         nonblock,             "run in background",         NULL   },
-      { "nounique", 'U', 0, G_OPTION_ARG_NONE,         &globalconf.nounique, "ignore libunique bindings", NULL   },
-      { "uri",      'u', 0, G_OPTION_ARG_STRING_ARRAY, &uris,                "uri(s) to load at startup", "URI"  },
-      { "verbose",  'v', 0, G_OPTION_ARG_NONE,         &globalconf.verbose,  "print debugging output",    NULL   },
-      { "version",  'V', 0, G_OPTION_ARG_NONE,         &version_only,        "print version and exit",    NULL   },
-      { NULL,       0,   0, 0,                         NULL,                 NULL,                        NULL   },
+      { "check",         'k', 0,                          G_OPTION_ARG_NONE,         &check_only,            "check config and exit",        NULL   },
+      { "config",        'c', 0,                          G_OPTION_ARG_STRING,       &globalconf.confpath,   "configuration file to use",    "FILE" },
+      { "daemon",        'D', 0,                          G_OPTION_ARG_NONE,         &globalconf.daemon,     "keep running without windows", NULL   },
+      { "nobytecode",    'B', 0,                          G_OPTION_ARG_NONE,         &globalconf.nobytecode, "don't cache compiled Lua",     NULL   },
+      { "nonblock",      'n', 0,                          G_OPTION_ARG_NONE,         nonblock,               "run in background",            NULL   },
+      { "nounique",      'U', 0,                          G_OPTION_ARG_NONE,         &globalconf.nounique,   "don't use the ipc socket",     NULL   },
+      { "profile",       'P', 0,                          G_OPTION_ARG_NONE,         &globalconf.profile,    "profile Lua/C calls",          NULL   },
+      { "trace-startup", 0,   G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK,     trace_startup_cb,       "write a startup trace",        "FILE" },
+      { "uri",           'u', 0,                          G_OPTION_ARG_STRING_ARRAY, &uris,                  "uri(s) to load at startup",    "URI"  },
+      { "verbose",       'v', 0,                          G_OPTION_ARG_NONE,         &globalconf.verbose,    "print debugging output",       NULL   },
+      { "version",       'V', 0,                          G_OPTION_ARG_NONE,         &version_only,          "print version and exit",       NULL   },
+      { NULL,            0,   0,                          0,                         NULL,                   NULL,                           NULL   },
     };
 
     /* parse command line options */
@@ -138,13 +146,12 @@ main(gint argc, gchar *argv[]) {
     gchar **uris = NULL;
     pid_t pid, sid;
 
-    /* clean up any zombies */
-    struct sigaction sigact;
-    sigact.sa_handler=sigchld;
-    sigemptyset (&sigact.sa_mask);
-    sigact.sa_flags = SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sigact, NULL))
-        fatal("Can't install SIGCHLD handler");
+    /* children are reaped by GLib child watches (see luapdf.spawn and the
+     * process class), a global waitpid(-1) reaper would take their exit
+     * status away */
+
+    /* report writes to closed pipes and sockets as EPIPE instead of dying */
+    signal(SIGPIPE, SIG_IGN);
 
     /* set numeric locale to C (required for compatibility with
        LuaJIT and luapdf scripts) */
@@ -169,21 +176,33 @@ main(gint argc, gchar *argv[]) {
         }
     }
 
+    trace_begin("gtk_init", NULL);
     gtk_init(&argc, &argv);
     if (!g_thread_supported())
         g_thread_init(NULL);
+    trace_end();
 
+    trace_begin("init_lua", NULL);
     init_directories();
     init_lua(uris);
+    trace_end();
 
     /* parse and run configuration file */
+    trace_begin("rc.lua", NULL);
     if(!luaH_parserc(globalconf.confpath, TRUE))
         fatal("couldn't find rc file");
+    trace_end();
 
-    if (!globalconf.windows->len)
+    if (!globalconf.windows->len && !globalconf.daemon)
         fatal("no windows spawned by rc file, exiting");
 
     gtk_main();
+
+    /* no document was painted */
+    trace_finish();
+
+    if (globalconf.profile)
+        profile_dump(stderr);
     return EXIT_SUCCESS;
 }
 
@@ -31,7 +31,7 @@ key_press_cb(GtkWidget* UNUSED(win), GdkEventKey *ev, widget_t *w)
 {
     lua_State *L = globalconf.L;
     luaH_object_push(L, w->ref);
-    luaH_modifier_table_push(L, ev->state);
+    luaH_modifiers_push(L, ev->state);
     luaH_keystr_push(L, ev->keyval);
     gint ret = luaH_object_emit_signal(L, -3, "key-press", 2, 1);
     gboolean catch = ret && lua_toboolean(L, -1) ? TRUE : FALSE;
@@ -45,7 +45,7 @@ button_cb(GtkWidget* UNUSED(win), GdkEventButton *ev, widget_t *w)
     gint ret;
     lua_State *L = globalconf.L;
     luaH_object_push(L, w->ref);
-    luaH_modifier_table_push(L, ev->state);
+    luaH_modifiers_push(L, ev->state);
     lua_pushinteger(L, ev->button);
 
     switch (ev->type) {
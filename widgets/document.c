@@ -21,10 +21,18 @@
 
 #include "luah.h"
 #include "clib/widget.h"
+#include "common/memory.h"
+#include "common/profile.h"
+#include "common/trace.h"
 #include "widgets/common.h"
 
 #include <gtk/gtk.h>
 #include <poppler.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
 
 typedef struct {
     const gchar *text;
@@ -34,21 +42,62 @@ typedef struct {
     GList *current_match;
 } search_data_t;
 
-typedef struct {
+typedef struct page_info_t {
+    /* position of the page in the document, starting at 0 */
+    guint index;
+    /* loaded on demand, use document_page_get() */
     PopplerPage *page;
     cairo_rectangle_t *rectangle;
+    /* the page rasterized at surface_zoom from the document generation
+     * surface_generation (see render.c) */
     cairo_surface_t *surface;
+    gdouble surface_zoom;
+    guint surface_generation;
+    /* cached page text, use document_page_text() */
+    gchar *text;
     GList *search_matches;
+    /* the Lua userdata block pointing back to this page (see pages.c) */
+    struct page_info_t **proxy;
+    /* the document this page belongs to */
+    struct document_data_t *owner;
 } page_info_t;
 
-typedef struct {
+typedef struct document_data_t {
     GtkWidget *widget;
-    /* document */
+    /* document, shared with all widgets showing the same file (see cache.c) */
+    struct document_cache_entry_t *cache;
     PopplerDocument *document;
-    const gchar *path;
-    const gchar *password;
+    /* incremented whenever a (possibly different) Poppler document is
+     * opened, invalidates the rasterized pages */
+    guint generation;
+    gchar *path;
+    gchar *password;
+    /* bytes held by this document (see common/memory.h) */
+    memory_client_t *memory;
+    /* the Poppler document and pages have been released, only the page
+     * geometry is kept */
+    gboolean hibernated;
     /* pages */
     GPtrArray *pages;
+    /* ref of the Lua pages array in the widget environment table */
+    gpointer pages_ref;
+    /* pages sorted by their offsets (see pagemap.c) */
+    GPtrArray *pagemap;
+    gdouble pagemap_max_height;
+    gboolean pagemap_dirty;
+    /* cached index of the page in the middle of the viewport, 0 if stale */
+    gint current_page;
+    /* pending scroll-changed emission and the values last emitted (see
+     * scroll.c) */
+    guint scroll_notify_id;
+    gint scroll_x, scroll_y, scroll_page, scroll_npages;
+    /* kinetic wheel scrolling, velocities in document units per second (see
+     * scroll.c) */
+    gboolean smooth_scroll;
+    gdouble scroll_step;
+    gdouble hvelocity, vvelocity;
+    gint64 scroll_time;
+    guint scroll_anim_id;
     /* drawing data */
     gint spacing;
     gdouble zoom;
@@ -58,6 +107,10 @@ typedef struct {
     gdouble height;
     /* searching */
     GList *current_match;
+    /* automatic reloading (see reload.c) */
+    gboolean auto_reload;
+    GFileMonitor *monitor;
+    guint reload_id;
 } document_data_t;
 
 static widget_t*
@@ -77,6 +130,31 @@ luaH_checkdocument_data(lua_State *L, gint udx)
     return d;
 }
 
+#define LUAPDF_PAGE_METATABLE "luapdf.page"
+
+/* Returns the page behind a page proxy or NULL if the value at the given
+ * index is not a page or its document has been unloaded. */
+static page_info_t*
+luaH_topage(lua_State *L, gint idx)
+{
+    page_info_t **p = lua_touserdata(L, idx);
+    if (!p || !lua_getmetatable(L, idx))
+        return NULL;
+    luaL_getmetatable(L, LUAPDF_PAGE_METATABLE);
+    gboolean is_page = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+    return is_page ? *p : NULL;
+}
+
+static page_info_t*
+luaH_checkpage(lua_State *L, gint idx)
+{
+    page_info_t **p = luaL_checkudata(L, idx, LUAPDF_PAGE_METATABLE);
+    if (!*p)
+        luaL_argerror(L, idx, "page of an unloaded document");
+    return *p;
+}
+
 static gint
 luaH_document_push_indexed_table(lua_State *L, lua_CFunction index, lua_CFunction newindex, gint idx)
 {
@@ -109,7 +187,78 @@ document_update_adjustments(document_data_t *d)
     d->vadjust->page_size = d->widget->allocation.height / d->zoom;
 }
 
+#include "widgets/document/cache.c"
+
+/* rough estimate of the memory held by a PopplerPage and its parsed content */
+#define DOCUMENT_PAGE_BYTES (16 * 1024)
+
+/* Reopens a hibernated document. Pages are loaded again on demand. */
+static gboolean
+document_wake(document_data_t *d)
+{
+    if (!d->hibernated)
+        return TRUE;
+    if (!d->path)
+        return FALSE;
+
+    GError *error = NULL;
+    document_cache_entry_t *cache = document_cache_open(d->path, d->password, &error);
+    if (!cache) {
+        warn("unable to restore %s: %s", d->path, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    debug("restoring hibernated document %s", d->path);
+    d->cache = cache;
+    d->document = cache->document;
+    d->generation++;
+    d->hibernated = FALSE;
+    return TRUE;
+}
+
+/* Returns the Poppler document, restoring it if it is hibernated. */
+static PopplerDocument *
+document_get(document_data_t *d)
+{
+    document_wake(d);
+    return d->document;
+}
+
+/* Returns the Poppler page, loading it again if it has been evicted. */
+static PopplerPage *
+document_page_get(page_info_t *p)
+{
+    document_data_t *d = p->owner;
+    if (!p->page && document_get(d)) {
+        p->page = document_cache_get_page(d->cache, p->index);
+        if (p->page)
+            memory_charge(d->memory, DOCUMENT_PAGE_BYTES);
+    }
+    memory_touch(d->memory);
+    return p->page;
+}
+
+/* Returns the text of the page. The text is cached until it is evicted. */
+static const gchar *
+document_page_text(page_info_t *p)
+{
+    PopplerPage *page;
+    if (!p->text && (page = document_page_get(p))) {
+        p->text = poppler_page_get_text(page);
+        memory_charge(p->owner->memory, l_strlen(p->text) + 1);
+    }
+    return p->text;
+}
+
+/* estimated memory held by a list of search matches */
+static gsize
+document_search_matches_bytes(GList *matches)
+{
+    return g_list_length(matches) * (sizeof(GList) + sizeof(PopplerRectangle));
+}
+
 #include "widgets/document/coordinates.c"
+#include "widgets/document/pagemap.c"
 #include "widgets/document/render.c"
 #include "widgets/document/index.c"
 #include "widgets/document/scroll.c"
@@ -117,63 +266,148 @@ document_update_adjustments(document_data_t *d)
 #include "widgets/document/pages.c"
 #include "widgets/document/printing.c"
 
+/* Releases the data derived from a page. Search matches are only released
+ * when `search` is set, as they are still shown in a visible document. */
 static void
-luaH_document_destructor(widget_t *w) {
-    document_data_t *d = w->data;
-    document_clear_search(d);
-    gtk_widget_destroy(GTK_WIDGET(d->widget));
-    /* release our reference on the document. Poppler handles freeing it */
-    if (d->document)
-        g_object_unref(G_OBJECT(d->document));
+page_free_caches(page_info_t *p, gboolean search)
+{
+    memory_client_t *m = p->owner->memory;
+    page_free_surface(p);
+    if (p->text) {
+        memory_charge(m, -(gssize) (strlen(p->text) + 1));
+        g_free(p->text);
+        p->text = NULL;
+    }
+    if (search)
+        page_free_search_matches(p);
+}
+
+/* Releases the Poppler page. It is loaded again by document_page_get(). */
+static void
+page_free_page(page_info_t *p)
+{
+    if (!p->page)
+        return;
     /* release our references on the pages. Poppler handles freeing it */
-    if (d->pages) {
-        for (guint i = 0; i < d->pages->len; ++i) {
-            page_info_t *p = g_ptr_array_index(d->pages, i);
-            g_object_unref(G_OBJECT(p->page));
-            cairo_surface_destroy(p->surface);
-            g_free(p->rectangle);
-            g_free(p);
-        }
-        g_ptr_array_free(d->pages, TRUE);
+    g_object_unref(G_OBJECT(p->page));
+    p->page = NULL;
+    memory_charge(p->owner->memory, -DOCUMENT_PAGE_BYTES);
+}
+
+static gboolean
+document_is_visible(gpointer data)
+{
+    document_data_t *d = data;
+    return gtk_widget_get_mapped(d->widget);
+}
+
+/* Releases the Poppler document and everything derived from it. Page
+ * geometry, page proxies, the scroll position and the zoom level are kept, so
+ * the document is restored transparently when it is used again. */
+static void
+document_hibernate(document_data_t *d)
+{
+    if (d->hibernated || !d->document)
+        return;
+
+    d->current_match = NULL;
+    for (guint i = 0; d->pages && i < d->pages->len; ++i) {
+        page_info_t *p = g_ptr_array_index(d->pages, i);
+        page_free_caches(p, TRUE);
+        page_free_page(p);
     }
-    g_object_unref(d->hadjust);
-    g_object_unref(d->vadjust);
-    g_free(d);
+    debug("hibernating document %s", NONULL(d->path));
+    document_cache_release(d->cache);
+    d->cache = NULL;
+    d->document = NULL;
+    d->hibernated = TRUE;
 }
 
-static int
-luaH_document_load(lua_State *L)
+/* memory governor callback */
+static void
+document_evict(gpointer data, memory_level_t level)
 {
-    document_data_t *d = luaH_checkdocument_data(L, 1);
-    if (!d->path)
-        luaL_error(L, "no path given to document class");
-    GError *error = NULL;
-    const gchar *uri = g_filename_to_uri(d->path, NULL, &error);
-    if (error)
-        luaL_error(L, error->message);
-    error = NULL;
-    d->document = poppler_document_new_from_file(uri, d->password, &error);
-    if (error)
-        luaL_error(L, error->message);
+    document_data_t *d = data;
+    gboolean visible = document_is_visible(d);
 
-    /* extract pages */
-    const gint size = poppler_document_get_n_pages(d->document);
-    d->pages = g_ptr_array_sized_new(size);
-    for (int i = 0; i < size; ++i) {
-        page_info_t *p = g_new0(page_info_t, 1);
-        p->page = poppler_document_get_page(d->document, i);
-        p->rectangle = g_new0(cairo_rectangle_t, 1);
-        poppler_page_get_size(p->page, &p->rectangle->width, &p->rectangle->height);
-        g_ptr_array_add(d->pages, p);
+    if (level == MEMORY_DOCUMENT) {
+        document_hibernate(d);
+        return;
     }
 
+    if (!visible)
+        d->current_match = NULL;
+    for (guint i = 0; d->pages && i < d->pages->len; ++i) {
+        page_info_t *p = g_ptr_array_index(d->pages, i);
+        if (level == MEMORY_CACHES)
+            page_free_caches(p, !visible);
+        else if (level == MEMORY_PAGES)
+            page_free_page(p);
+    }
+}
+
+static gint
+luaH_document_hibernate(lua_State *L)
+{
+    document_hibernate(luaH_checkdocument_data(L, 1));
+    return 0;
+}
+
+static page_info_t *
+page_new(document_data_t *d, guint index)
+{
+    page_info_t *p = g_new0(page_info_t, 1);
+    p->index = index;
+    p->owner = d;
+    p->rectangle = g_new0(cairo_rectangle_t, 1);
+    PopplerPage *page = document_page_get(p);
+    if (page)
+        poppler_page_get_size(page, &p->rectangle->width, &p->rectangle->height);
+    return p;
+}
+
+/* Frees a page and invalidates its proxy. */
+static void
+page_free(page_info_t *p)
+{
+    if (p->proxy)
+        *p->proxy = NULL;
+    page_free_caches(p, TRUE);
+    page_free_page(p);
+    g_free(p->rectangle);
+    g_free(p);
+}
+
+/* Releases all pages of the document. Page proxies which are still referenced
+ * from Lua are invalidated. */
+static void
+document_free_pages(document_data_t *d)
+{
+    if (!d->pages)
+        return;
+
+    d->current_match = NULL;
+    for (guint i = 0; i < d->pages->len; ++i)
+        page_free(g_ptr_array_index(d->pages, i));
+    g_ptr_array_free(d->pages, TRUE);
+    d->pages = NULL;
+    d->pages_ref = NULL;
+    document_pagemap_invalidate(d);
+}
+
+/* Lets the Lua layout handler position the pages and configures the
+ * adjustments for the resulting document size. */
+static void
+document_layout(lua_State *L, gint udx, document_data_t *d)
+{
     /* calculate page geometry and positioning */
-    gint ret = luaH_object_emit_signal(L, 1, "layout", 0, 2);
+    gint ret = luaH_object_emit_signal(L, udx, "layout", 0, 2);
     if (!ret)
         luaL_error(L, "no layout was definied");
 
     gdouble height = luaL_checknumber(L, -1);
     gdouble width = luaL_checknumber(L, -2);
+    lua_pop(L, 2);
 
     d->width = width;
     d->height = height;
@@ -182,6 +416,64 @@ luaH_document_load(lua_State *L)
     d->hadjust->upper = width;
     d->vadjust->upper = height;
     document_update_adjustments(d);
+    document_scroll_notify(d);
+}
+
+#include "widgets/document/reload.c"
+
+static void
+luaH_document_destructor(widget_t *w) {
+    document_data_t *d = w->data;
+    document_unwatch(d);
+    if (d->scroll_notify_id)
+        g_source_remove(d->scroll_notify_id);
+    document_scroll_stop(d);
+    gtk_widget_destroy(GTK_WIDGET(d->widget));
+    document_free_pages(d);
+    if (d->pagemap)
+        g_ptr_array_free(d->pagemap, TRUE);
+    document_cache_release(d->cache);
+    memory_client_free(d->memory);
+    g_object_unref(d->hadjust);
+    g_object_unref(d->vadjust);
+    g_free(d->path);
+    g_free(d->password);
+    g_free(d);
+}
+
+static int
+luaH_document_load(lua_State *L)
+{
+    document_data_t *d = luaH_checkdocument_data(L, 1);
+    if (!d->path)
+        luaL_error(L, "no path given to document class");
+    GError *error = NULL;
+    document_cache_entry_t *cache = document_cache_open(d->path, d->password, &error);
+    if (!cache) {
+        lua_pushstring(L, error->message);
+        g_error_free(error);
+        return lua_error(L);
+    }
+
+    /* drop the previously loaded document */
+    if (d->pages_ref)
+        luaH_object_unref_item(L, 1, d->pages_ref);
+    document_free_pages(d);
+    document_cache_release(d->cache);
+    d->cache = cache;
+    d->document = cache->document;
+    d->generation++;
+    d->hibernated = FALSE;
+    d->memory->name = d->path;
+
+    /* extract pages */
+    const gint size = poppler_document_get_n_pages(d->document);
+    d->pages = g_ptr_array_sized_new(size);
+    for (int i = 0; i < size; ++i)
+        g_ptr_array_add(d->pages, page_new(d, i));
+
+    document_layout(L, 1, d);
+    document_watch(luaH_checkdocument(L, 1));
     return 0;
 }
 
@@ -192,7 +484,7 @@ luaH_document_push_links(lua_State *L, document_data_t *d)
     gint k = 1;
     for (guint i = 0; i < d->pages->len; ++i) {
         page_info_t *p = g_ptr_array_index(d->pages, i);
-        GList *link_mapping = poppler_page_get_link_mapping(p->page);
+        GList *link_mapping = poppler_page_get_link_mapping(document_page_get(p));
         GList *l = link_mapping;
         while (l) {
             PopplerLinkMapping *m = l->data;
@@ -245,28 +537,41 @@ luaH_document_index(lua_State *L, luapdf_token_t token)
       PF_CASE(PRINT,            luaH_document_print)
       PF_CASE(CLEAR_SEARCH,     luaH_document_clear_search)
       PF_CASE(HIGHLIGHT_MATCH,  luaH_document_highlight_match)
+      PF_CASE(PAGE_AT,          luaH_document_page_at)
+      PF_CASE(HIBERNATE,        luaH_document_hibernate)
+      PF_CASE(RELOAD,           luaH_document_reload)
+
+      /* booleans */
+      PB_CASE(HIBERNATED,       d->hibernated)
+      PB_CASE(AUTO_RELOAD,      d->auto_reload)
+      PB_CASE(SMOOTH_SCROLL,    d->smooth_scroll)
 
       /* strings */
       PS_CASE(PATH,     d->path)
       PS_CASE(PASSWORD, d->password)
-      PS_CASE(TITLE,    poppler_document_get_title(d->document))
-      PS_CASE(AUTHOR,   poppler_document_get_author(d->document))
-      PS_CASE(SUBJECT,  poppler_document_get_subject(d->document))
-      PS_CASE(KEYWORDS, poppler_document_get_keywords(d->document))
-      PS_CASE(CREATOR,  poppler_document_get_creator(d->document))
-      PS_CASE(PRODUCER, poppler_document_get_producer(d->document))
+      PS_CASE(TITLE,    poppler_document_get_title(document_get(d)))
+      PS_CASE(AUTHOR,   poppler_document_get_author(document_get(d)))
+      PS_CASE(SUBJECT,  poppler_document_get_subject(document_get(d)))
+      PS_CASE(KEYWORDS, poppler_document_get_keywords(document_get(d)))
+      PS_CASE(CREATOR,  poppler_document_get_creator(document_get(d)))
+      PS_CASE(PRODUCER, poppler_document_get_producer(document_get(d)))
 
       /* numbers */
       PN_CASE(ZOOM,     d->zoom)
+      PN_CASE(SCROLL_STEP, d->scroll_step)
+      PI_CASE(CURRENT_PAGE, document_current_page(d))
 
       case L_TK_SCROLL:
         return luaH_document_push_indexed_table(L, luaH_document_scroll_index, luaH_document_scroll_newindex, 1);
 
       case L_TK_PAGES:
-        return luaH_document_push_pages(L, d);
+        return luaH_document_push_pages(L, 1, d);
 
       case L_TK_INDEX:
-        return luaH_document_push_index(L, poppler_index_iter_new(d->document), d);
+        return luaH_document_push_index(L, poppler_index_iter_new(document_get(d)), d);
+
+      case L_TK_INDEX_ITER:
+        return luaH_document_push_index_iter(L, 1, d);
 
       case L_TK_LINKS:
         return luaH_document_push_links(L, d);
@@ -288,22 +593,37 @@ luaH_document_newindex(lua_State *L, luapdf_token_t token)
       LUAPDF_WIDGET_INDEX_COMMON
 
       case L_TK_PATH:
-        if (lua_isnil(L, 3))
-            d->path = NULL;
-        else
-            d->path = luaL_checkstring(L, 3);
+        g_free(d->path);
+        d->path = lua_isnil(L, 3) ? NULL : g_strdup(luaL_checkstring(L, 3));
+        d->memory->name = d->path;
+        break;
+
+      case L_TK_AUTO_RELOAD:
+        d->auto_reload = luaH_checkboolean(L, 3);
+        if (d->pages)
+            document_watch(luaH_checkdocument(L, 1));
+        break;
+
+      case L_TK_SMOOTH_SCROLL:
+        d->smooth_scroll = luaH_checkboolean(L, 3);
+        if (!d->smooth_scroll)
+            document_scroll_stop(d);
+        break;
+
+      case L_TK_SCROLL_STEP:
+        d->scroll_step = luaL_checknumber(L, 3);
         break;
 
       case L_TK_PASSWORD:
-        if (lua_isnil(L, 3))
-            d->password = NULL;
-        else
-            d->password = luaL_checkstring(L, 3);
+        g_free(d->password);
+        d->password = lua_isnil(L, 3) ? NULL : g_strdup(luaL_checkstring(L, 3));
         break;
 
       case L_TK_ZOOM:
         d->zoom = luaL_checknumber(L, 3);
         document_update_adjustments(d);
+        d->current_page = 0;
+        document_scroll_notify(d);
         document_render(d);
         break;
 
@@ -325,12 +645,35 @@ static void
 resize_cb(gpointer *UNUSED(p), GdkRectangle *UNUSED(r), document_data_t *d)
 {
     document_update_adjustments(d);
+    d->current_page = 0;
+    document_scroll_notify(d);
+}
+
+/* restore a hibernated document as soon as it is shown again */
+static void
+map_cb(GtkWidget *UNUSED(w), document_data_t *d)
+{
+    document_wake(d);
+    memory_touch(d->memory);
+}
+
+static void
+adjustment_changed_cb(GtkAdjustment *UNUSED(a), document_data_t *d)
+{
+    d->current_page = 0;
+    document_scroll_notify(d);
 }
 
 static void
 expose_cb(GtkWidget *UNUSED(w), GdkEventExpose *UNUSED(e), document_data_t *d)
 {
     document_render(d);
+
+    /* the startup is complete once the first document is painted */
+    if (d->document && trace_enabled()) {
+        trace_mark("first paint");
+        trace_finish();
+    }
 }
 
 static gboolean
@@ -338,7 +681,7 @@ luaH_emit_button_event(lua_State *L, const gchar *event, widget_t *w, gint butto
 {
     document_data_t *d = w->data;
     luaH_object_push(L, w->ref);
-    luaH_modifier_table_push(L, state);
+    luaH_modifiers_push(L, state);
     lua_pushinteger(L, button);
     gdouble x, y;
     document_coordinates_from_widget_coordinates(ex, ey, &x, &y, d);
@@ -357,9 +700,16 @@ luaH_emit_button_event(lua_State *L, const gchar *event, widget_t *w, gint butto
     return catch;
 }
 
+/* Unmodified wheel events scroll smoothly, all others are passed to the
+ * button binds as buttons 4 to 7. */
 static gboolean
 scroll_event_cb(GtkWidget *UNUSED(v), GdkEventScroll *ev, widget_t *w)
 {
+    document_data_t *d = w->data;
+    if (d->smooth_scroll && !(ev->state & gtk_accelerator_get_default_mod_mask())) {
+        document_scroll_kinetic(d, ev->direction);
+        return TRUE;
+    }
     return luaH_emit_button_event(globalconf.L, "button-release", w, ((int)ev->direction) + 4, ev->state, ev->x, ev->y);
 }
 
@@ -392,6 +742,12 @@ widget_document(widget_t *w, luapdf_token_t UNUSED(token))
     g_object_ref_sink(d->hadjust);
     d->vadjust = GTK_ADJUSTMENT(gtk_adjustment_new(0, 0, 0, 10, 1, 0));
     g_object_ref_sink(d->vadjust);
+    d->memory = memory_client_new(document_evict, document_is_visible, d);
+    d->auto_reload = TRUE;
+    d->smooth_scroll = TRUE;
+    d->scroll_step = 40;
+    /* nothing emitted yet, the first scroll-changed always fires */
+    d->scroll_x = d->scroll_y = d->scroll_page = d->scroll_npages = -2;
     w->data = d;
 
     w->widget = d->widget;
@@ -403,14 +759,19 @@ widget_document(widget_t *w, luapdf_token_t UNUSED(token))
     w->destructor = luaH_document_destructor;
 
     g_object_connect(G_OBJECT(d->hadjust),
+      "signal::value-changed",        G_CALLBACK(adjustment_changed_cb), d,
       "signal::value-changed",        G_CALLBACK(render_cb),         d,
+      "signal::changed",              G_CALLBACK(adjustment_changed_cb), d,
       NULL);
     g_object_connect(G_OBJECT(d->vadjust),
+      "signal::value-changed",        G_CALLBACK(adjustment_changed_cb), d,
       "signal::value-changed",        G_CALLBACK(render_cb),         d,
+      "signal::changed",              G_CALLBACK(adjustment_changed_cb), d,
       NULL);
     g_object_connect(G_OBJECT(d->widget),
       "signal::expose-event",         G_CALLBACK(expose_cb),            d,
       "signal::size-allocate",        G_CALLBACK(resize_cb),            d,
+      "signal::map",                  G_CALLBACK(map_cb),               d,
       "signal::scroll-event",         G_CALLBACK(scroll_event_cb),      w,
       "signal::button-press-event",   G_CALLBACK(document_button_cb),   w,
       "signal::button-release-event", G_CALLBACK(document_button_cb),   w,
@@ -0,0 +1,217 @@
+/*
+ * widgets/document/cache.c - Shared Poppler document cache
+ *
+ * Copyright © 2010 Fabian Streitel <luapdf@rottenrei.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+/* Every file is parsed only once, no matter how many document widgets show
+ * it. The cache entries are keyed by the canonical path, size and modification
+ * time of the file and the password it was opened with, and are freed when
+ * the last widget releases them. */
+
+typedef struct document_cache_entry_t {
+    /* canonical path, size, mtime and password hash (see document_cache_key) */
+    gchar *key;
+    gchar *path;
+    PopplerDocument *document;
+    /* the mapping or the copy of the file poppler reads from, both NULL if it
+     * streams the file (see document_cache_open_mapped) */
+    GMappedFile *mapping;
+    gchar *data;
+    /* weak pointers to the pages currently loaded by any widget */
+    PopplerPage **pages;
+    gint npages;
+    /* number of widgets using this entry */
+    gint refcount;
+    /* the mapped or copied file */
+    memory_client_t *memory;
+} document_cache_entry_t;
+
+static GHashTable *document_cache;
+
+/* Opens the file from memory if mapping is enabled (luapdf.mmap_limit), so
+ * poppler doesn't read from the file while it is being rewritten. Only files
+ * nobody may write to are mapped: poppler reads straight from the page cache
+ * and several views of the same file share the kernel pages. A mapped file
+ * which is truncated raises SIGBUS on the next access, so writable files, e.g.
+ * the output of a TeX run, are copied into the heap instead. Huge files and
+ * everything when mapping is disabled (the default) are streamed. */
+static PopplerDocument *
+document_cache_open_mapped(const gchar *path, const gchar *password,
+        struct stat *st, GMappedFile **mapping, gchar **data, GError **error)
+{
+    *mapping = NULL;
+    *data = NULL;
+    goffset size = st->st_size;
+    if (size > 0 && (gsize) size <= globalconf.mmap_limit && size <= G_MAXINT) {
+        GError *map_error = NULL;
+        gsize length = 0;
+        struct stat now;
+
+        if (st->st_mode & (S_IWUSR | S_IWGRP | S_IWOTH))
+            g_file_get_contents(path, data, &length, &map_error);
+        else if ((*mapping = g_mapped_file_new(path, FALSE, &map_error))) {
+            /* the file must not have changed since it was checked */
+            length = g_mapped_file_get_length(*mapping);
+            if (g_stat(path, &now) || now.st_size != st->st_size
+                    || (now.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH))
+                    || (goffset) length != size) {
+                g_mapped_file_unref(*mapping);
+                *mapping = NULL;
+            }
+        }
+
+        if (*mapping || *data) {
+            PopplerDocument *document = poppler_document_new_from_data(
+                    *mapping ? g_mapped_file_get_contents(*mapping) : *data,
+                    length, password, error);
+            if (!document) {
+                if (*mapping)
+                    g_mapped_file_unref(*mapping);
+                g_free(*data);
+                *mapping = NULL;
+                *data = NULL;
+            }
+            return document;
+        }
+        /* not mappable (e.g. a pipe) or changed while opening; stream it */
+        if (map_error) {
+            debug("unable to map %s: %s", path, map_error->message);
+            g_error_free(map_error);
+        }
+    }
+
+    gchar *uri = g_filename_to_uri(path, NULL, error);
+    if (!uri)
+        return NULL;
+    PopplerDocument *document = poppler_document_new_from_file(uri, password, error);
+    g_free(uri);
+    return document;
+}
+
+/* Builds the cache key of a file. The mtime has nanosecond resolution so a
+ * rewrite within the same second isn't mistaken for the old file, and only a
+ * hash of the password is kept so an encrypted document is never shared with
+ * an open using a different password. */
+static gchar *
+document_cache_key(const gchar *path, struct stat *st, const gchar *password)
+{
+    gchar *real = realpath(path, NULL);
+    gchar *hash = password ? g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+            password, -1) : NULL;
+    gchar *key = g_strdup_printf("%s:%" G_GINT64_FORMAT ":%ld.%09ld:%s",
+            real ? real : path, (gint64) st->st_size, (glong) st->st_mtim.tv_sec,
+            (glong) st->st_mtim.tv_nsec, NONULL(hash));
+    g_free(hash);
+    free(real);
+    return key;
+}
+
+/* Returns a reference to the cache entry of the given file, opening the file
+ * if it is not in the cache yet. */
+static document_cache_entry_t *
+document_cache_open(const gchar *path, const gchar *password, GError **error)
+{
+    struct stat st;
+    if (g_stat(path, &st)) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "unable to open %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    gchar *key = document_cache_key(path, &st, password);
+
+    if (!document_cache)
+        document_cache = g_hash_table_new(g_str_hash, g_str_equal);
+
+    document_cache_entry_t *e = g_hash_table_lookup(document_cache, key);
+    if (e) {
+        g_free(key);
+        e->refcount++;
+        return e;
+    }
+
+    GMappedFile *mapping;
+    gchar *data;
+    PopplerDocument *document = document_cache_open_mapped(path, password,
+            &st, &mapping, &data, error);
+    if (!document) {
+        g_free(key);
+        return NULL;
+    }
+
+    e = g_new0(document_cache_entry_t, 1);
+    e->key = key;
+    e->path = g_strdup(path);
+    e->document = document;
+    e->mapping = mapping;
+    e->data = data;
+    e->npages = poppler_document_get_n_pages(document);
+    e->pages = g_new0(PopplerPage*, e->npages);
+    e->refcount = 1;
+    e->memory = memory_client_new(NULL, NULL, NULL);
+    e->memory->name = e->path;
+    if (mapping || data)
+        memory_charge(e->memory, st.st_size);
+    g_hash_table_insert(document_cache, e->key, e);
+    return e;
+}
+
+/* Returns a new reference to a page of the document. Pages are shared between
+ * all widgets showing the same file. */
+static PopplerPage *
+document_cache_get_page(document_cache_entry_t *e, gint index)
+{
+    if (index < 0 || index >= e->npages)
+        return NULL;
+    if (e->pages[index])
+        return g_object_ref(e->pages[index]);
+    PopplerPage *page = poppler_document_get_page(e->document, index);
+    if (page) {
+        e->pages[index] = page;
+        g_object_add_weak_pointer(G_OBJECT(page), (gpointer*) &e->pages[index]);
+    }
+    return page;
+}
+
+static void
+document_cache_release(document_cache_entry_t *e)
+{
+    if (!e || --e->refcount)
+        return;
+
+    g_hash_table_remove(document_cache, e->key);
+    for (gint i = 0; i < e->npages; i++)
+        if (e->pages[i])
+            g_object_remove_weak_pointer(G_OBJECT(e->pages[i]),
+                    (gpointer*) &e->pages[i]);
+    /* release our reference on the document. Poppler handles freeing it */
+    g_object_unref(G_OBJECT(e->document));
+    /* the document reads from the mapping or copy until it is gone */
+    if (e->mapping)
+        g_mapped_file_unref(e->mapping);
+    g_free(e->data);
+    memory_client_free(e->memory);
+    g_free(e->pages);
+    g_free(e->path);
+    g_free(e->key);
+    g_free(e);
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
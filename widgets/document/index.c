@@ -83,4 +83,97 @@ luaH_document_push_index(lua_State *L, PopplerIndexIter *iter, document_data_t *
     return 1;
 }
 
+#define LUAPDF_INDEX_WALK_METATABLE "luapdf.index_walk"
+
+/* state of a stepwise walk through the index (see
+ * luaH_document_push_index_iter) */
+typedef struct {
+    /* the document whose index is walked */
+    PopplerDocument *document;
+    /* iterators of the next entry and of its parents, innermost last */
+    GPtrArray *stack;
+} index_walk_t;
+
+static void
+index_walk_clear(index_walk_t *walk)
+{
+    while (walk->stack->len) {
+        poppler_index_iter_free(g_ptr_array_index(walk->stack,
+                    walk->stack->len - 1));
+        g_ptr_array_remove_index(walk->stack, walk->stack->len - 1);
+    }
+}
+
+static gint
+luaH_document_index_walk_gc(lua_State *L)
+{
+    index_walk_t *walk = lua_touserdata(L, 1);
+    index_walk_clear(walk);
+    g_ptr_array_free(walk->stack, TRUE);
+    return 0;
+}
+
+/* Returns the title, destination and depth (starting at 1) of the next
+ * index entry, or nothing once all entries were returned or the document
+ * has been reloaded or hibernated. */
+static gint
+luaH_document_index_step(lua_State *L)
+{
+    document_data_t *d = luaH_checkdocument_data(L, lua_upvalueindex(1));
+    index_walk_t *walk = lua_touserdata(L, lua_upvalueindex(2));
+
+    if (d->document != walk->document)
+        index_walk_clear(walk);
+    if (!walk->stack->len)
+        return 0;
+
+    GPtrArray *stack = walk->stack;
+    PopplerIndexIter *iter = g_ptr_array_index(stack, stack->len - 1);
+    PopplerAction *action = poppler_index_iter_get_action(iter);
+    lua_pushstring(L, action->any.title);
+    luaH_push_action(L, action, d);
+    lua_pushinteger(L, stack->len);
+    poppler_action_free(action);
+
+    /* advance to the first child, else to the next sibling of the entry or
+     * of its closest parent which has one */
+    PopplerIndexIter *child = poppler_index_iter_get_child(iter);
+    if (child)
+        g_ptr_array_add(stack, child);
+    else while (stack->len) {
+        iter = g_ptr_array_index(stack, stack->len - 1);
+        if (poppler_index_iter_next(iter))
+            break;
+        poppler_index_iter_free(iter);
+        g_ptr_array_remove_index(stack, stack->len - 1);
+    }
+    return 3;
+}
+
+/* Pushes an iterator function over the index of the document at `udx`. Each
+ * call does the work for one entry only, so large indexes can be walked
+ * between redraws. */
+static gint
+luaH_document_push_index_iter(lua_State *L, gint udx, document_data_t *d)
+{
+    lua_pushvalue(L, udx);
+
+    index_walk_t *walk = lua_newuserdata(L, sizeof(index_walk_t));
+    walk->document = document_get(d);
+    walk->stack = g_ptr_array_new();
+    if (luaL_newmetatable(L, LUAPDF_INDEX_WALK_METATABLE)) {
+        lua_pushcfunction(L, luaH_document_index_walk_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    PopplerIndexIter *iter = walk->document
+        ? poppler_index_iter_new(walk->document) : NULL;
+    if (iter)
+        g_ptr_array_add(walk->stack, iter);
+
+    lua_pushcclosure(L, luaH_document_index_step, 2);
+    return 1;
+}
+
 // vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -0,0 +1,140 @@
+/*
+ * widgets/document/pagemap.c - Page lookup by position
+ *
+ * Copyright © 2010 Fabian Streitel <karottenreibe@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+/* The page map keeps the pages of a document sorted by their vertical
+ * offset. It is rebuilt lazily whenever a page has been moved, which usually
+ * only happens once per layout. */
+
+static gint
+pagemap_cmp(gconstpointer a, gconstpointer b)
+{
+    const cairo_rectangle_t *x = (*(page_info_t**) a)->rectangle;
+    const cairo_rectangle_t *y = (*(page_info_t**) b)->rectangle;
+    if (x->y != y->y)
+        return x->y < y->y ? -1 : 1;
+    return (x->x > y->x) - (x->x < y->x);
+}
+
+/* Marks the page map and the cached current page as stale. */
+static void
+document_pagemap_invalidate(document_data_t *d)
+{
+    d->pagemap_dirty = TRUE;
+    d->current_page = 0;
+}
+
+static void
+document_pagemap_update(document_data_t *d)
+{
+    if (!d->pagemap_dirty && d->pagemap)
+        return;
+
+    if (!d->pagemap)
+        d->pagemap = g_ptr_array_new();
+    g_ptr_array_set_size(d->pagemap, 0);
+    d->pagemap_max_height = 0;
+
+    for (guint i = 0; d->pages && i < d->pages->len; ++i) {
+        page_info_t *p = g_ptr_array_index(d->pages, i);
+        g_ptr_array_add(d->pagemap, p);
+        if (p->rectangle->height > d->pagemap_max_height)
+            d->pagemap_max_height = p->rectangle->height;
+    }
+    g_ptr_array_sort(d->pagemap, pagemap_cmp);
+    d->pagemap_dirty = FALSE;
+}
+
+/* Returns the number of pages in the page map whose top edge is above or at
+ * the given offset. */
+static guint
+document_pagemap_count_above(document_data_t *d, gdouble y)
+{
+    guint lo = 0, hi = d->pagemap->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        page_info_t *p = g_ptr_array_index(d->pagemap, mid);
+        if (p->rectangle->y <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the page containing the given point in document coordinates or NULL
+ * if the point lies between pages. */
+static page_info_t *
+document_page_at(document_data_t *d, gdouble x, gdouble y)
+{
+    document_pagemap_update(d);
+
+    /* only pages starting at most one page height above the point can contain
+     * it, so there is no need to look further back */
+    for (guint i = document_pagemap_count_above(d, y); i > 0; --i) {
+        page_info_t *p = g_ptr_array_index(d->pagemap, i - 1);
+        cairo_rectangle_t *r = p->rectangle;
+        if (r->y < y - d->pagemap_max_height)
+            break;
+        if (x >= r->x && x <= r->x + r->width && y <= r->y + r->height)
+            return p;
+    }
+    return NULL;
+}
+
+/* Returns the index (starting at 1) of the page in the middle of the
+ * viewport. If the middle lies between pages, the closest page above it is
+ * used. */
+static gint
+document_current_page(document_data_t *d)
+{
+    if (d->current_page && !d->pagemap_dirty)
+        return d->current_page;
+    if (!d->pages || !d->pages->len)
+        return 0;
+
+    gdouble x = gtk_adjustment_get_value(d->hadjust)
+        + gtk_adjustment_get_page_size(d->hadjust) / 2;
+    gdouble y = gtk_adjustment_get_value(d->vadjust)
+        + gtk_adjustment_get_page_size(d->vadjust) / 2;
+
+    page_info_t *p = document_page_at(d, x, y);
+    if (!p) {
+        guint n = document_pagemap_count_above(d, y);
+        p = g_ptr_array_index(d->pagemap, n ? n - 1 : 0);
+    }
+    return d->current_page = p->index + 1;
+}
+
+static gint
+luaH_document_page_at(lua_State *L)
+{
+    document_data_t *d = luaH_checkdocument_data(L, 1);
+    gdouble x = luaL_checknumber(L, 2);
+    gdouble y = luaL_checknumber(L, 3);
+    page_info_t *p = document_page_at(d, x, y);
+    if (!p)
+        return 0;
+    lua_pushinteger(L, p->index + 1);
+    return 1;
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -22,41 +22,43 @@
 static gint
 luaH_document_page_newindex(lua_State *L)
 {
-    page_info_t *p = lua_touserdata(L, lua_upvalueindex(1));
+    page_info_t *p = luaH_checkpage(L, 1);
     const gchar *prop = luaL_checkstring(L, 2);
     luapdf_token_t t = l_tokenize(prop);
 
+    gint64 start = PROFILE_START();
+
     gdouble value = luaL_checknumber(L, 3);
     if (t == L_TK_X) p->rectangle->x = value;
     else if (t == L_TK_Y) p->rectangle->y = value;
+    if (t == L_TK_X || t == L_TK_Y)
+        document_pagemap_invalidate(p->owner);
 
+    if (start)
+        profile_record_property(PROFILE_NEWINDEX, "page", prop, start);
     return 0;
 }
 
 static gint
-luaH_document_page_index(lua_State *L)
+luaH_document_page_index_real(lua_State *L)
 {
-    page_info_t *p = lua_touserdata(L, lua_upvalueindex(1));
+    page_info_t *p = luaH_checkpage(L, 1);
     const gchar *prop = luaL_checkstring(L, 2);
     luapdf_token_t t = l_tokenize(prop);
 
     switch(t)
     {
-      /* closures */
-      case L_TK_SEARCH:
-        lua_pushvalue(L, lua_upvalueindex(1));
-        lua_pushcclosure(L, luaH_page_search, 1);
-        return 1;
+      /* functions */
+      PF_CASE(SEARCH,   luaH_page_search)
 
       /* numbers */
       PN_CASE(X,        p->rectangle->x)
       PN_CASE(Y,        p->rectangle->y)
       PN_CASE(WIDTH,    p->rectangle->width)
       PN_CASE(HEIGHT,   p->rectangle->height)
-      PN_CASE(INDEX,    poppler_page_get_index(p->page) + 1)
+      PN_CASE(INDEX,    p->index + 1)
 
-      /* strings */
-      PS_CASE(TEXT,     poppler_page_get_text(p->page))
+      PS_CASE(TEXT,     document_page_text(p))
 
       case L_TK_SEARCH_MATCHES:
         luaH_push_search_matches_table(L, p);
@@ -70,16 +72,83 @@ luaH_document_page_index(lua_State *L)
 }
 
 static gint
-luaH_document_push_pages(lua_State *L, document_data_t *d)
+luaH_document_page_index(lua_State *L)
+{
+    gint64 start = PROFILE_START();
+    gint ret = luaH_document_page_index_real(L);
+    if (start)
+        profile_record_property(PROFILE_INDEX, "page",
+                luaL_checkstring(L, 2), start);
+    return ret;
+}
+
+/* detach a collected proxy from its page */
+static gint
+luaH_document_page_gc(lua_State *L)
+{
+    page_info_t **p = lua_touserdata(L, 1);
+    if (*p)
+        (*p)->proxy = NULL;
+    return 0;
+}
+
+static gint
+luaH_document_page_tostring(lua_State *L)
 {
-    lua_createtable(L, 0, d->pages->len);
+    page_info_t *p = luaH_topage(L, 1);
+    if (p)
+        lua_pushfstring(L, "page %d", p->index + 1);
+    else
+        lua_pushliteral(L, "page (unloaded)");
+    return 1;
+}
+
+/* Pushes the metatable shared by all page proxies. */
+static void
+luaH_document_push_page_metatable(lua_State *L)
+{
+    if (luaL_newmetatable(L, LUAPDF_PAGE_METATABLE)) {
+        lua_pushcfunction(L, luaH_document_page_index);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, luaH_document_page_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, luaH_document_page_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushcfunction(L, luaH_document_page_tostring);
+        lua_setfield(L, -2, "__tostring");
+    }
+}
+
+/* Pushes the pages array of the document at `udx`. The array and its page
+ * proxies are created once per loaded document and kept in the environment
+ * table of the widget, so repeated accesses to doc.pages are free. */
+static gint
+luaH_document_push_pages(lua_State *L, gint udx, document_data_t *d)
+{
+    if (d->pages_ref)
+        return luaH_object_push_item(L, udx, d->pages_ref);
+
+    if (!d->pages) {
+        lua_newtable(L);
+        return 1;
+    }
+
+    lua_createtable(L, d->pages->len, 0);
+    luaH_document_push_page_metatable(L);
     for (guint i = 0; i < d->pages->len; ++i) {
         page_info_t *p = g_ptr_array_index(d->pages, i);
-        lua_pushlightuserdata(L, p);
-        luaH_document_push_indexed_table(L, luaH_document_page_index, luaH_document_page_newindex, lua_gettop(L));
-        lua_remove(L, -2);
-        lua_rawseti(L, -2, i + 1);
+        page_info_t **proxy = lua_newuserdata(L, sizeof(page_info_t*));
+        *proxy = p;
+        p->proxy = proxy;
+        lua_pushvalue(L, -2);
+        lua_setmetatable(L, -2);
+        lua_rawseti(L, -3, i + 1);
     }
+    lua_pop(L, 1);
+
+    /* keep the array alive as long as the document is loaded */
+    lua_pushvalue(L, -1);
+    d->pages_ref = luaH_object_ref_item(L, udx, -1);
     return 1;
 }
 
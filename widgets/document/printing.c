@@ -24,7 +24,7 @@ draw_page_cb(GtkPrintOperation *UNUSED(op), GtkPrintContext *cx, int index, docu
 {
     cairo_t *c = gtk_print_context_get_cairo_context(cx);
     page_info_t* p = g_ptr_array_index(d->pages, index);
-    if (p) poppler_page_render(p->page, c);
+    if (p) poppler_page_render(document_page_get(p), c);
 }
 
 static void
@@ -57,7 +57,7 @@ document_print(document_data_t *d, page_info_t *p, GtkWindow *w)
 
     GtkPrintSettings *settings = gtk_print_settings_new();
     if (p) {
-        gint index = poppler_page_get_index(p->page) - 1;
+        gint index = p->index - 1;
         GtkPageRange range = { index, index };
         gtk_print_settings_set_page_ranges(settings, &range, 1);
         gtk_print_settings_set_print_pages(settings, GTK_PRINT_PAGES_RANGES);
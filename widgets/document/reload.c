@@ -0,0 +1,237 @@
+/*
+ * widgets/document/reload.c - Automatic reloading of changed documents
+ *
+ * Copyright © 2010 Fabian Streitel <luapdf@rottenrei.be>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+/* Documents are reloaded when their file changes on disk. Pages whose
+ * content did not change keep their rasterized surface, text and search
+ * matches, and the zoom level and scroll position are kept as well. */
+
+/* time to wait for further changes before reloading, so a file which is
+ * still being written is not loaded half-way */
+#define DOCUMENT_RELOAD_DELAY 300
+
+/* scale of the raster hashed into the page fingerprints. Changes to the text
+ * are always noticed, changes of graphics smaller than a few points may be
+ * missed. */
+#define PAGE_FINGERPRINT_SCALE 0.25
+
+/* Returns a hash of the size, text and a low-resolution raster of the page,
+ * to be freed with g_free(). */
+static gchar *
+page_fingerprint(PopplerPage *page)
+{
+    GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA1);
+    gdouble width, height;
+    poppler_page_get_size(page, &width, &height);
+    g_checksum_update(sum, (const guchar *) &width, sizeof(width));
+    g_checksum_update(sum, (const guchar *) &height, sizeof(height));
+
+    gchar *text = poppler_page_get_text(page);
+    if (text)
+        g_checksum_update(sum, (const guchar *) text, strlen(text) + 1);
+    g_free(text);
+
+    gint w = MAX(1, ceil(width * PAGE_FINGERPRINT_SCALE));
+    gint h = MAX(1, ceil(height * PAGE_FINGERPRINT_SCALE));
+    cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+    if (cairo_surface_status(s) == CAIRO_STATUS_SUCCESS) {
+        cairo_t *c = cairo_create(s);
+        cairo_set_source_rgb(c, 1, 1, 1);
+        cairo_paint(c);
+        cairo_scale(c, PAGE_FINGERPRINT_SCALE, PAGE_FINGERPRINT_SCALE);
+        poppler_page_render(page, c);
+        cairo_destroy(c);
+        cairo_surface_flush(s);
+        g_checksum_update(sum, cairo_image_surface_get_data(s),
+                cairo_image_surface_get_stride(s) * h);
+    }
+    cairo_surface_destroy(s);
+
+    gchar *ret = g_strdup(g_checksum_get_string(sum));
+    g_checksum_free(sum);
+    return ret;
+}
+
+static gint
+luaH_document_reload(lua_State *L)
+{
+    document_data_t *d = luaH_checkdocument_data(L, 1);
+    if (!d->path || !d->pages)
+        luaL_error(L, "document not loaded");
+
+    GError *error = NULL;
+    document_cache_entry_t *cache = document_cache_open(d->path, d->password, &error);
+    if (!cache) {
+        lua_pushstring(L, error->message);
+        g_error_free(error);
+        return lua_error(L);
+    }
+    if (cache == d->cache) {
+        /* the file has not changed */
+        document_cache_release(cache);
+        return 0;
+    }
+
+    document_cache_entry_t *old = d->cache;
+    guint n = poppler_document_get_n_pages(cache->document);
+    guint kept = 0;
+    d->cache = cache;
+    d->document = cache->document;
+    d->generation++;
+    d->hibernated = FALSE;
+    d->current_match = NULL;
+
+    /* keep the caches of pages whose fingerprint did not change. Only pages
+     * with caches are compared, the others have nothing to keep */
+    for (guint i = 0; i < MIN(n, d->pages->len); ++i) {
+        page_info_t *p = g_ptr_array_index(d->pages, i);
+        PopplerPage *before = NULL;
+        if (old && (p->surface || p->text || p->search_matches))
+            before = p->page ? g_object_ref(p->page)
+                : poppler_document_get_page(old->document, i);
+        page_free_page(p);
+
+        PopplerPage *page = document_page_get(p);
+        gboolean same = FALSE;
+        if (before && page) {
+            gchar *a = page_fingerprint(before);
+            gchar *b = page_fingerprint(page);
+            same = !g_strcmp0(a, b);
+            g_free(a);
+            g_free(b);
+        }
+        if (before)
+            g_object_unref(before);
+
+        if (same) {
+            p->surface_generation = d->generation;
+            kept++;
+            continue;
+        }
+        page_free_caches(p, TRUE);
+        if (page) {
+            gdouble width, height;
+            poppler_page_get_size(page, &width, &height);
+            p->rectangle->width = width;
+            p->rectangle->height = height;
+        }
+    }
+
+    if (n != d->pages->len) {
+        /* the Lua pages array is rebuilt on the next access */
+        for (guint i = 0; i < d->pages->len; ++i) {
+            page_info_t *p = g_ptr_array_index(d->pages, i);
+            if (p->proxy)
+                *p->proxy = NULL;
+            p->proxy = NULL;
+        }
+        if (d->pages_ref)
+            luaH_object_unref_item(L, 1, d->pages_ref);
+        d->pages_ref = NULL;
+
+        for (guint i = n; i < d->pages->len; ++i)
+            page_free(g_ptr_array_index(d->pages, i));
+        if (n < d->pages->len)
+            g_ptr_array_remove_range(d->pages, n, d->pages->len - n);
+        for (guint i = d->pages->len; i < n; ++i)
+            g_ptr_array_add(d->pages, page_new(d, i));
+    }
+
+    document_cache_release(old);
+    document_pagemap_invalidate(d);
+    document_layout(L, 1, d);
+    gtk_widget_queue_draw(d->widget);
+
+    debug("reloaded %s, kept the caches of %u of %u pages", d->path, kept, n);
+    luaH_object_emit_signal(L, 1, "reload", 0, 0);
+    return 0;
+}
+
+static gboolean
+document_reload_cb(widget_t *w)
+{
+    document_data_t *d = w->data;
+    lua_State *L = globalconf.L;
+    d->reload_id = 0;
+
+    lua_pushcfunction(L, luaH_document_reload);
+    luaH_object_push(L, w->ref);
+    if (lua_pcall(L, 1, 0, 0)) {
+        warn("unable to reload %s: %s", d->path, lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    return FALSE;
+}
+
+static void
+document_file_changed_cb(GFileMonitor *UNUSED(m), GFile *UNUSED(f),
+        GFile *UNUSED(o), GFileMonitorEvent e, widget_t *w)
+{
+    document_data_t *d = w->data;
+    if (e != G_FILE_MONITOR_EVENT_CHANGED &&
+            e != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+            e != G_FILE_MONITOR_EVENT_CREATED)
+        return;
+
+    /* wait until the file has not been written to for a while */
+    if (d->reload_id)
+        g_source_remove(d->reload_id);
+    d->reload_id = g_timeout_add(DOCUMENT_RELOAD_DELAY,
+            (GSourceFunc) document_reload_cb, w);
+}
+
+static void
+document_unwatch(document_data_t *d)
+{
+    if (d->reload_id)
+        g_source_remove(d->reload_id);
+    d->reload_id = 0;
+    if (d->monitor) {
+        g_file_monitor_cancel(d->monitor);
+        g_object_unref(d->monitor);
+    }
+    d->monitor = NULL;
+}
+
+/* Starts watching the file of the document if automatic reloading is
+ * enabled. */
+static void
+document_watch(widget_t *w)
+{
+    document_data_t *d = w->data;
+    document_unwatch(d);
+    if (!d->auto_reload || !d->path)
+        return;
+
+    GError *error = NULL;
+    GFile *file = g_file_new_for_path(d->path);
+    d->monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+    g_object_unref(file);
+    if (!d->monitor) {
+        warn("unable to watch %s: %s", d->path, error->message);
+        g_error_free(error);
+        return;
+    }
+    g_signal_connect(d->monitor, "changed",
+            G_CALLBACK(document_file_changed_cb), w);
+}
+
+// vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
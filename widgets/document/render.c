@@ -31,13 +31,82 @@ document_page_is_visible(document_data_t *d, page_info_t *p)
 static void
 page_render(cairo_t *c, page_info_t *i)
 {
-    PopplerPage *p = i->page;
+    PopplerPage *p = document_page_get(i);
     /* render background */
     cairo_rectangle(c, 0, 0, i->rectangle->width, i->rectangle->height);
     cairo_set_source_rgb(c, 1, 1, 1);
     cairo_fill(c);
     /* render page */
-    poppler_page_render(p, c);
+    if (p)
+        poppler_page_render(p, c);
+}
+
+/* pages larger than this many pixels (16 MiB) are rendered directly instead
+ * of being cached, a strongly zoomed page would need hundreds of megabytes */
+#define PAGE_SURFACE_MAX_PIXELS (2048 * 2048)
+
+/* The rasterized neighbours of the visible pages are only kept while all
+ * rasterized pages of a document take at most this share of the memory
+ * limit (see common/memory.h). */
+#define PAGE_SURFACE_BUDGET_SHARE 4
+
+/* Returns the bytes held by the rasterized page. */
+static gsize
+page_surface_size(page_info_t *p)
+{
+    if (!p->surface)
+        return 0;
+    return (gsize) cairo_image_surface_get_stride(p->surface)
+        * cairo_image_surface_get_height(p->surface);
+}
+
+/* Releases the rasterized page. */
+static void
+page_free_surface(page_info_t *p)
+{
+    if (!p->surface)
+        return;
+    memory_charge(p->owner->memory, -(gssize) page_surface_size(p));
+    cairo_surface_destroy(p->surface);
+    p->surface = NULL;
+}
+
+/* Returns the page rasterized at the given zoom level. The surface is cached
+ * until the zoom level changes, the document is reopened or it is evicted,
+ * so redrawing a page while scrolling only copies pixels. Returns NULL if
+ * the page can't be cached. */
+static cairo_surface_t *
+page_surface(page_info_t *p, gdouble zoom)
+{
+    if (p->surface && p->surface_zoom == zoom
+            && p->surface_generation == p->owner->generation)
+        return p->surface;
+    page_free_surface(p);
+
+    /* don't cache a blank page if the page can't be loaded right now */
+    if (!document_page_get(p))
+        return NULL;
+
+    gint width = ceil(p->rectangle->width * zoom);
+    gint height = ceil(p->rectangle->height * zoom);
+    if (width <= 0 || height <= 0 || (gdouble) width * height > PAGE_SURFACE_MAX_PIXELS)
+        return NULL;
+
+    cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    if (cairo_surface_status(s) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(s);
+        return NULL;
+    }
+    cairo_t *c = cairo_create(s);
+    cairo_scale(c, zoom, zoom);
+    page_render(c, p);
+    cairo_destroy(c);
+
+    p->surface = s;
+    p->surface_zoom = zoom;
+    p->surface_generation = p->owner->generation;
+    memory_charge(p->owner->memory, cairo_image_surface_get_stride(s) * height);
+    return s;
 }
 
 static void
@@ -51,14 +120,26 @@ document_render(document_data_t *d)
     cairo_paint(c);
 
     /* render pages with scroll and zoom */
-    for (guint i = 0; i < d->pages->len; ++i) {
+    guint first = G_MAXUINT, last = 0;
+    for (guint i = 0; d->pages && i < d->pages->len; ++i) {
         page_info_t *p = g_ptr_array_index(d->pages, i);
         if (document_page_is_visible(d, p)) {
-            /* render page */
-            cairo_scale(c, d->zoom, d->zoom);
-            cairo_translate(c, p->rectangle->x - d->hadjust->value, p->rectangle->y - d->vadjust->value);
-            page_render(c, p);
-            cairo_identity_matrix(c);
+            first = MIN(first, i);
+            last = i;
+
+            /* copy the rasterized page, aligned to whole pixels */
+            cairo_surface_t *s = page_surface(p, d->zoom);
+            if (s) {
+                cairo_set_source_surface(c, s,
+                        floor((p->rectangle->x - d->hadjust->value) * d->zoom),
+                        floor((p->rectangle->y - d->vadjust->value) * d->zoom));
+                cairo_paint(c);
+            } else {
+                cairo_scale(c, d->zoom, d->zoom);
+                cairo_translate(c, p->rectangle->x - d->hadjust->value, p->rectangle->y - d->vadjust->value);
+                page_render(c, p);
+                cairo_identity_matrix(c);
+            }
 
             /* render search matches */
             GList *m = p->search_matches;
@@ -82,6 +163,24 @@ document_render(document_data_t *d)
         }
     }
     cairo_destroy(c);
+
+    /* keep the rasterized neighbours of the visible pages for scrolling,
+     * unless they would take too much memory */
+    gsize used = 0;
+    for (guint i = first; d->pages && i <= last; ++i)
+        used += page_surface_size(g_ptr_array_index(d->pages, i));
+    gsize budget = memory_get_limit() / PAGE_SURFACE_BUDGET_SHARE;
+    for (guint i = 0; d->pages && i < d->pages->len; ++i) {
+        page_info_t *p = g_ptr_array_index(d->pages, i);
+        if (i >= first && i <= last)
+            continue;
+        if (first != G_MAXUINT && (i + 1 == first || i == last + 1)) {
+            used += page_surface_size(p);
+            if (!budget || used <= budget)
+                continue;
+        }
+        page_free_surface(p);
+    }
 }
 
 // vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -19,6 +19,91 @@
  *
  */
 
+/* Kinetic scrolling: every wheel notch adds to the velocity of the axis and
+ * the velocity decays exponentially, so a notch moves the view by scroll_step
+ * in total and fast turns of the wheel add up. A frame timer advances the
+ * position by the distance covered since the last frame. */
+
+/* interval between two animation frames */
+#define DOCUMENT_SCROLL_FRAME_INTERVAL 16
+/* time constant of the velocity decay in seconds */
+#define DOCUMENT_SCROLL_DECAY 0.12
+/* the animation stops below this velocity (document units per second) */
+#define DOCUMENT_SCROLL_MIN_VELOCITY 5.0
+
+/* Sets an adjustment to a value clamped to its range. Returns FALSE if the
+ * value had to be clamped. */
+static gboolean
+document_scroll_set(GtkAdjustment *a, gdouble value)
+{
+    gdouble max = gtk_adjustment_get_upper(a) - gtk_adjustment_get_page_size(a);
+    gdouble clamped = CLAMP(value, 0, MAX(max, 0));
+    gtk_adjustment_set_value(a, clamped);
+    return clamped == value;
+}
+
+/* Stops a running scroll animation. */
+static void
+document_scroll_stop(document_data_t *d)
+{
+    if (d->scroll_anim_id)
+        g_source_remove(d->scroll_anim_id);
+    d->scroll_anim_id = 0;
+    d->hvelocity = d->vvelocity = 0;
+}
+
+/* Moves an axis by the distance covered in dt seconds and decays its
+ * velocity. The velocity is dropped at the end of the document. */
+static void
+document_scroll_advance(GtkAdjustment *a, gdouble *velocity, gdouble dt)
+{
+    if (*velocity == 0)
+        return;
+    gdouble decay = exp(-dt / DOCUMENT_SCROLL_DECAY);
+    gdouble delta = *velocity * DOCUMENT_SCROLL_DECAY * (1 - decay);
+    *velocity *= decay;
+    if (!document_scroll_set(a, gtk_adjustment_get_value(a) + delta)
+            || fabs(*velocity) < DOCUMENT_SCROLL_MIN_VELOCITY)
+        *velocity = 0;
+}
+
+static gboolean
+document_scroll_frame_cb(gpointer data)
+{
+    document_data_t *d = data;
+    gint64 now = l_monotonic_time();
+    gdouble dt = (now - d->scroll_time) / 1e6;
+    d->scroll_time = now;
+
+    document_scroll_advance(d->hadjust, &d->hvelocity, dt);
+    document_scroll_advance(d->vadjust, &d->vvelocity, dt);
+
+    if (d->hvelocity != 0 || d->vvelocity != 0)
+        return TRUE;
+    d->scroll_anim_id = 0;
+    return FALSE;
+}
+
+/* Starts or speeds up a scroll animation for a wheel event. */
+static void
+document_scroll_kinetic(document_data_t *d, GdkScrollDirection direction)
+{
+    /* a velocity of step / decay covers exactly one step */
+    gdouble impulse = d->scroll_step / DOCUMENT_SCROLL_DECAY;
+    switch (direction) {
+      case GDK_SCROLL_UP:    d->vvelocity -= impulse; break;
+      case GDK_SCROLL_DOWN:  d->vvelocity += impulse; break;
+      case GDK_SCROLL_LEFT:  d->hvelocity -= impulse; break;
+      case GDK_SCROLL_RIGHT: d->hvelocity += impulse; break;
+      default: return;
+    }
+    if (!d->scroll_anim_id) {
+        d->scroll_time = l_monotonic_time();
+        d->scroll_anim_id = g_timeout_add(DOCUMENT_SCROLL_FRAME_INTERVAL,
+                document_scroll_frame_cb, d);
+    }
+}
+
 static gint
 luaH_document_scroll_newindex(lua_State *L)
 {
@@ -26,21 +111,24 @@ luaH_document_scroll_newindex(lua_State *L)
     document_data_t *d = luaH_checkdocument_data(L, lua_upvalueindex(1));
     const gchar *prop = luaL_checkstring(L, 2);
     luapdf_token_t t = l_tokenize(prop);
+    gint64 start = PROFILE_START();
 
     GtkAdjustment *a;
     if (t == L_TK_X)      a = d->hadjust;
     else if (t == L_TK_Y) a = d->vadjust;
     else return 0;
 
-    gdouble value = luaL_checknumber(L, 3);
-    gdouble max = gtk_adjustment_get_upper(a) -
-            gtk_adjustment_get_page_size(a);
-    gtk_adjustment_set_value(a, ((value < 0 ? 0 : value) > max ? max : value));
+    /* an explicit position ends the animation */
+    document_scroll_stop(d);
+    document_scroll_set(a, luaL_checknumber(L, 3));
+
+    if (start)
+        profile_record_property(PROFILE_NEWINDEX, "scroll", prop, start);
     return 0;
 }
 
 static gint
-luaH_document_scroll_index(lua_State *L)
+luaH_document_scroll_index_real(lua_State *L)
 {
     document_data_t *d = luaH_checkdocument_data(L, lua_upvalueindex(1));
     const gchar *prop = luaL_checkstring(L, 2);
@@ -64,4 +152,81 @@ luaH_document_scroll_index(lua_State *L)
     return 0;
 }
 
+static gint
+luaH_document_scroll_index(lua_State *L)
+{
+    gint64 start = PROFILE_START();
+    gint ret = luaH_document_scroll_index_real(L);
+    if (start)
+        profile_record_property(PROFILE_INDEX, "scroll",
+                luaL_checkstring(L, 2), start);
+    return ret;
+}
+
+/* interval between two scroll-changed signals, about one frame */
+#define DOCUMENT_SCROLL_NOTIFY_INTERVAL 16
+
+/* Returns the position of an adjustment in percent or -1 if the document fits
+ * into the viewport. 100 is only returned at the very end. */
+static gint
+document_scroll_percent(GtkAdjustment *a)
+{
+    gdouble max = gtk_adjustment_get_upper(a) - gtk_adjustment_get_page_size(a);
+    if (max <= 0)
+        return -1;
+    gint percent = (gint) (gtk_adjustment_get_value(a) / max * 100);
+    return CLAMP(percent, 0, 100);
+}
+
+static void
+document_scroll_push_percent(lua_State *L, gint percent)
+{
+    if (percent < 0)
+        lua_pushnil(L);
+    else
+        lua_pushinteger(L, percent);
+}
+
+/* Emits scroll-changed if the scroll position, current page or page count
+ * changed since the last emission. */
+static gboolean
+document_scroll_notify_cb(gpointer data)
+{
+    document_data_t *d = data;
+    d->scroll_notify_id = 0;
+
+    gint x = document_scroll_percent(d->hadjust);
+    gint y = document_scroll_percent(d->vadjust);
+    gint page = document_current_page(d);
+    gint npages = d->pages ? (gint) d->pages->len : 0;
+    if (x == d->scroll_x && y == d->scroll_y && page == d->scroll_page
+            && npages == d->scroll_npages)
+        return FALSE;
+    d->scroll_x = x;
+    d->scroll_y = y;
+    d->scroll_page = page;
+    d->scroll_npages = npages;
+
+    widget_t *w = g_object_get_data(G_OBJECT(d->widget), "lua_widget");
+    lua_State *L = globalconf.L;
+    luaH_object_push(L, w->ref);
+    document_scroll_push_percent(L, x);
+    document_scroll_push_percent(L, y);
+    lua_pushinteger(L, page);
+    lua_pushinteger(L, npages);
+    luaH_object_emit_signal(L, -5, "scroll-changed", 4, 0);
+    lua_pop(L, 1);
+    return FALSE;
+}
+
+/* Schedules a scroll-changed signal. Changes within one interval are merged
+ * into a single emission. */
+static void
+document_scroll_notify(document_data_t *d)
+{
+    if (!d->scroll_notify_id)
+        d->scroll_notify_id = g_timeout_add(DOCUMENT_SCROLL_NOTIFY_INTERVAL,
+                document_scroll_notify_cb, d);
+}
+
 // vim: ft=c:et:sw=4:ts=8:sts=4:tw=80
@@ -34,12 +34,28 @@ luaH_push_search_matches_table(lua_State *L, page_info_t *p)
     return 1;
 }
 
+static void
+page_free_search_matches(page_info_t *p)
+{
+    memory_charge(p->owner->memory,
+            -(gssize) document_search_matches_bytes(p->search_matches));
+    g_list_foreach(p->search_matches, (GFunc) poppler_rectangle_free, NULL);
+    g_list_free(p->search_matches);
+    p->search_matches = NULL;
+}
+
 static gint
 luaH_page_search(lua_State *L)
 {
-    page_info_t *p = lua_touserdata(L, lua_upvalueindex(1));
+    page_info_t *p = luaH_checkpage(L, 1);
     const gchar *text = luaL_checkstring(L, 2);
-    p->search_matches = poppler_page_find_text(p->page, text);
+    page_free_search_matches(p);
+    PopplerPage *page = document_page_get(p);
+    if (!page)
+        return 0;
+    p->search_matches = poppler_page_find_text(page, text);
+    memory_charge(p->owner->memory,
+            document_search_matches_bytes(p->search_matches));
     return 0;
 }
 
@@ -47,12 +63,8 @@ static void
 document_clear_search(document_data_t *d)
 {
     d->current_match = NULL;
-    for (guint i = 0; i < d->pages->len; ++i) {
-        page_info_t *p = g_ptr_array_index(d->pages, i);
-        if (p->search_matches)
-            g_list_free(p->search_matches);
-        p->search_matches = NULL;
-    }
+    for (guint i = 0; d->pages && i < d->pages->len; ++i)
+        page_free_search_matches(g_ptr_array_index(d->pages, i));
     document_render(d);
 }
 
@@ -62,20 +74,18 @@ luaH_document_highlight_match(lua_State *L)
     document_data_t *d = luaH_checkdocument_data(L, 1);
     luaH_checktable(L, 2);
 
-    // TODO: handle this without __data and remove __data again
     lua_pushstring(L, "page");
-    lua_gettable(L, -2);
-    lua_pushstring(L, "__data");
-    lua_rawget(L, -2);
-    page_info_t *p = lua_touserdata(L, -1);
-    lua_pop(L, 2);
+    lua_gettable(L, 2);
+    page_info_t *p = luaH_topage(L, -1);
+    lua_pop(L, 1);
 
     lua_pushstring(L, "match");
-    lua_gettable(L, -2);
+    lua_gettable(L, 2);
     GList *match = lua_touserdata(L, -1);
     lua_pop(L, 1);
 
-    if (!match || !p)
+    /* the match must still belong to the page */
+    if (!match || !p || g_list_position(p->search_matches, match) < 0)
         luaL_typerror(L, 2, "search match");
 
     d->current_match = match;